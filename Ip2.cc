@@ -53,6 +53,10 @@
 #include "ns3/random-variable-stream.h"
 #include "ns3/constant-position-mobility-model.h"
 
+#include "scenario-instrument.h"
+#include "scenario-telemetry.h"
+#include "topology-bench.h"
+
 // Network topology (TCP/IP Protocol)
 //                   q1
 //
@@ -114,6 +118,10 @@ int main (int argc, char *argv[])
 
   double load = 0.5;
 
+  bool instrument = false;
+  std::string eventProfile;
+  std::string benchTopology;
+
 
   //-----------------------------------
   //   PARSE COMMAND LINE ARGUMENTS
@@ -134,8 +142,15 @@ int main (int argc, char *argv[])
   cmd.AddValue ("qlen",       "Max number of bytes that can be enqueued",                qlen);
   // Load
   cmd.AddValue ("load",       "Load", load);
+  // Instrumentation
+  cmd.AddValue ("instrument", "Print phase wall times and event rates to stderr", instrument);
+  cmd.AddValue ("eventProfile", "Profile event callbacks: ranked table on stderr, folded stacks to this file", eventProfile);
+  // Micro-benchmarks
+  cmd.AddValue ("benchTopology", "Micro-benchmark link setup at these comma-separated link counts and exit", benchTopology);
 
   cmd.Parse(argc, argv);
+  RunInstrument run ("Ip2", instrument, eventProfile);
+  StatusTelemetry status ("Ip2");  // progress file when SCENARIO_STATUS_FILE is set
 
 
   //------------------------
@@ -169,6 +184,11 @@ int main (int argc, char *argv[])
   } else {
     NS_ABORT_MSG ("Invalid queue type: Use --queueType=RED or --queueType=DropTail");
   }
+  if (!benchTopology.empty ()) {
+    BenchLinks ("Ip2", benchTopology, qType);
+    return 0;
+  }
+  run.Mark ("configuration");
 
 
   //------------------------
@@ -177,6 +197,7 @@ int main (int argc, char *argv[])
   // Center routers
   NodeContainer n;
   n.Create(numNodes);
+  run.Mark ("nodes");
 
 
   //------------------------
@@ -291,6 +312,7 @@ int main (int argc, char *argv[])
   // Create vector of NetDeviceContainer to loop through when assigning ip addresses
   NetDeviceContainer devsArray[] = {dc0c3, dc1c2, dc0c1, dc3l4, dc3l5, dc3l6, dc2r7, dc2r8, dc2r9};
   std::vector<NetDeviceContainer> devices(devsArray, devsArray + sizeof(devsArray) / sizeof(NetDeviceContainer));
+  run.Mark ("devices");
 
 
   //-------------------------
@@ -305,20 +327,15 @@ int main (int argc, char *argv[])
   std::cerr << "Installing internet stack" << std::endl;
   InternetStackHelper stack;
   stack.Install (n);
+  run.Mark ("stack");
   
 
   //------------------------
   //    ADD IP ADDRESSES
   //------------------------
   // Hardware is in place. Now assign IP addresses
-  Ipv4AddressHelper ipv4;
-  std::vector<Ipv4InterfaceContainer> ifaceLinks(numNodes-1);
-  for(uint32_t i=0; i<devices.size(); ++i) {
-    std::ostringstream subnet;
-    subnet << "10.1." << i+1 << ".0";
-    ipv4.SetBase(subnet.str().c_str(), "255.255.255.0");
-    ifaceLinks[i] = ipv4.Assign(devices[i]);
-  }
+  std::vector<Ipv4InterfaceContainer> ifaceLinks = AssignLinkSubnets (devices);
+  run.Mark ("addresses");
 
 
   //---------------------------
@@ -385,6 +402,7 @@ int main (int argc, char *argv[])
   AnimationInterface animInterface(animFile);
   animInterface.EnablePacketMetadata(true);
   std::cerr << "\nSaving animation file: " << animFile << std::endl;
+  run.Mark ("applications");
 
 
   //------------------------------
@@ -394,15 +412,16 @@ int main (int argc, char *argv[])
   // to tell nodes how to route packets. A routing table is the next top route
   // to the possible routing destinations.
   Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+  run.Mark ("routing");
 
 
   //---------------------
   //    RUN SIMULATION
   //---------------------
   std::cout << "\nRuning simulation..." << std::endl;
-  Simulator::Stop (Seconds (10.0));
-  Simulator::Run ();
-  Simulator::Destroy ();
+  ScenarioStop (Seconds (10.0));
+  run.Run ();
+  run.Destroy (n.GetN ());
   std::cout << "\nSimulation finished!" << std::endl;
 
   std::cerr << "queueType = " << queueType << "\n"
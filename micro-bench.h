@@ -0,0 +1,115 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Micro-benchmark harness for the scenario building blocks.
+//
+// A case is a class with three methods: Prepare () builds whatever one
+// sample needs and is not timed, Run () is the code under test, and
+// Cleanup () tears the sample down (also not timed). Each case runs a few
+// warm-up samples that are thrown away, then a fixed number of timed
+// samples, and prints one line:
+//
+//   microBench,p3,case,ApplicationSetup,size,200,samples,15,median(us),..,
+//   mean(us),..,stddev(us),..,ci95(us),..,min(us),..,perUnit(ns),..
+//
+// perUnit divides the median by the units of work in one sample (flows,
+// links, packets), so sizes can be compared directly. MICRO_BENCH_WARMUP
+// (default 3) and MICRO_BENCH_SAMPLES (default 15) override the counts.
+//
+
+#ifndef MICRO_BENCH_H
+#define MICRO_BENCH_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdint.h>
+#include <time.h>
+
+class MicroBench
+{
+public:
+  explicit MicroBench (const std::string &scenario)
+    : m_scenario (scenario),
+      m_warmup (3),
+      m_samples (15)
+  {
+    const char *warmup = getenv ("MICRO_BENCH_WARMUP");
+    if (warmup)
+      {
+        m_warmup = atoi (warmup);
+      }
+    const char *samples = getenv ("MICRO_BENCH_SAMPLES");
+    if (samples && atoi (samples) > 1)
+      {
+        m_samples = atoi (samples);
+      }
+  }
+
+  // Time bench.Run () and print the summary; units is the work in one sample
+  template <typename Case>
+  void Measure (const std::string &name, uint32_t size, Case &bench, double units)
+  {
+    std::vector<double> us;
+    for (uint32_t i = 0; i < m_warmup + m_samples; i++)
+      {
+        bench.Prepare ();
+        double start = Now ();
+        bench.Run ();
+        double elapsed = (Now () - start) * 1e6;
+        bench.Cleanup ();
+        if (i >= m_warmup)
+          {
+            us.push_back (elapsed);
+          }
+      }
+    Print (name, size, us, units);
+  }
+
+  static double Now (void)
+  {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+private:
+  void Print (const std::string &name, uint32_t size, std::vector<double> us, double units) const
+  {
+    std::sort (us.begin (), us.end ());
+    uint32_t n = us.size ();
+    double median = n % 2 ? us[n / 2] : (us[n / 2 - 1] + us[n / 2]) / 2;
+    double mean = 0;
+    for (uint32_t i = 0; i < n; i++)
+      {
+        mean += us[i];
+      }
+    mean /= n;
+    double var = 0;
+    for (uint32_t i = 0; i < n; i++)
+      {
+        var += (us[i] - mean) * (us[i] - mean);
+      }
+    double stddev = n > 1 ? std::sqrt (var / (n - 1)) : 0;
+    std::cout << "microBench," << m_scenario;
+    std::cout << ",case," << name;
+    std::cout << ",size," << size;
+    std::cout << ",samples," << n;
+    std::cout << ",median(us)," << median;
+    std::cout << ",mean(us)," << mean;
+    std::cout << ",stddev(us)," << stddev;
+    // Normal approximation; samples are few, so read it as a rough bound
+    std::cout << ",ci95(us)," << 1.96 * stddev / std::sqrt ((double) n);
+    std::cout << ",min(us)," << us[0];
+    std::cout << ",perUnit(ns)," << (units > 0 ? median * 1e3 / units : 0.0);
+    std::cout << std::endl;
+  }
+
+  std::string m_scenario;
+  uint32_t m_warmup;
+  uint32_t m_samples;
+};
+
+#endif /* MICRO_BENCH_H */
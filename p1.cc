@@ -41,12 +41,20 @@
 #include "ns3/packet-sink.h"
 #include "ns3/random-variable-stream.h"
 
+#include "scenario-batch.h"
+#include "result-cache.h"
+#include "scenario-instrument.h"
+#include "scenario-telemetry.h"
+#include "topology-bench.h"
+#include "scenario-log.h"
+
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE ("TcpBulkSendExample");
 
-int
-main (int argc, char *argv[])
+//One parameter point; the whole program unless --batch is given
+static int
+RunPoint (int argc, char *argv[])
 {
 
   bool tracing = false;
@@ -56,8 +64,9 @@ main (int argc, char *argv[])
   uint32_t segSize_Bytes = 128;
   uint32_t nFlows = 1;
   uint32_t tcpType = 0;
-
- LogComponentEnable("TcpBulkSendExample", LOG_LEVEL_ALL);
+  bool instrument = false;
+  std::string eventProfile;
+  std::string benchTopology;
 
 
 // Allow the user to override any of the defaults at
@@ -84,7 +93,13 @@ Ptr<UniformRandomVariable> randNumber = CreateObject<UniformRandomVariable> ();
   
   cmd.AddValue ("nFlows"   , "Number of Simultaneous Flows "                , nFlows);
   
+  cmd.AddValue ("instrument", "Print phase wall times and event rates to stderr", instrument);
+  cmd.AddValue ("eventProfile", "Profile event callbacks: ranked table on stderr, folded stacks to this file", eventProfile);
+  cmd.AddValue ("benchTopology", "Micro-benchmark dumbbell setup at these comma-separated flow counts and exit", benchTopology);
+  
   cmd.Parse (argc, argv);
+  RunInstrument run ("p1", instrument, eventProfile);
+  StatusTelemetry status ("p1");  // progress file when SCENARIO_STATUS_FILE is set
 
 //
 // Set the parameters as per the command line inputs
@@ -93,11 +108,11 @@ Ptr<UniformRandomVariable> randNumber = CreateObject<UniformRandomVariable> ();
   //Config::SetDefault ("ns3::TcpSocket::RcvBufSize", UintegerValue(winSize_Bytes));
 
     if (tcpType == 0) {
-        NS_LOG_INFO ("Setting TCP Flavour to Tahoe");
+        SCENARIO_LOG_INFO ("Setting TCP Flavour to Tahoe");
         Config::SetDefault ("ns3::TcpL4Protocol::SocketType", StringValue("ns3::TcpTahoe"));
         } 
     else {
-        NS_LOG_INFO ("Setting TCP Flavour to Reno");
+        SCENARIO_LOG_INFO ("Setting TCP Flavour to Reno");
         Config::SetDefault ("ns3::TcpL4Protocol::SocketType", StringValue("ns3::TcpReno"));
         } 
 
@@ -106,6 +121,25 @@ Ptr<UniformRandomVariable> randNumber = CreateObject<UniformRandomVariable> ();
    Config::SetDefault ("ns3::DropTailQueue::Mode", EnumValue (DropTailQueue::QUEUE_MODE_BYTES));
    Config::SetDefault ("ns3::DropTailQueue::MaxBytes", UintegerValue(queueSize_Bytes));
    Config::SetDefault ("ns3::TcpSocket::SegmentSize", UintegerValue(segSize_Bytes));
+
+   if (!benchTopology.empty ())
+     {
+       BenchDumbbell ("p1", benchTopology);
+       return 0;
+     }
+
+   // Skip the simulation when this exact point has been run before
+   ResultCache cache ("p1", argc, argv);
+   // Reports on stderr time this very run; traces would not be restored
+   if (tracing || instrument || !eventProfile.empty ())
+     {
+       cache.Bypass ("profiling or tracing");
+     }
+   if (cache.Replay ())
+     {
+       return 0;
+     }
+   run.Mark ("configuration");
 //
 // Explicitly create the nodes required by the topology (shown above).
 //
@@ -117,21 +151,24 @@ Ptr<UniformRandomVariable> randNumber = CreateObject<UniformRandomVariable> ();
    p2pRouters.SetDeviceAttribute  ("DataRate", StringValue ("1Mbps"));
    p2pRouters.SetChannelAttribute ("Delay",    StringValue ("20ms"));
    PointToPointDumbbellHelper dumbbell (nFlows, p2pLeaf, nFlows, p2pLeaf, p2pRouters);
+   run.Mark ("devices");  // the helper creates the nodes as well
 
   InternetStackHelper stack;
   dumbbell.InstallStack (stack);
+  run.Mark ("stack");
 
   Ipv4AddressHelper ltIps     = Ipv4AddressHelper ("10.1.1.0", "255.255.255.0");
      Ipv4AddressHelper rtIps     = Ipv4AddressHelper ("10.2.1.0", "255.255.255.0");
      Ipv4AddressHelper routerIps = Ipv4AddressHelper ("10.3.1.0", "255.255.255.0");
      dumbbell.AssignIpv4Addresses(ltIps, rtIps, routerIps);
+     run.Mark ("addresses");
 
 
 
 //
 //
 
-  NS_LOG_INFO ("Create Applications.");
+  SCENARIO_LOG_INFO ("Create Applications.");
 
 //
 // Create a BulkSendApplication and install it on node 0
@@ -168,15 +205,17 @@ Ptr<UniformRandomVariable> randNumber = CreateObject<UniformRandomVariable> ();
     sinkApps[i].Stop (Seconds (10.0));
 
     }
+  run.Mark ("applications");
 
   Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+  run.Mark ("routing");
  
 
-  NS_LOG_INFO ("Run Simulation.");
-  Simulator::Stop (Seconds (10.0));
-  Simulator::Run ();
-  Simulator::Destroy ();
-  NS_LOG_INFO ("Done.");
+  SCENARIO_LOG_INFO ("Run Simulation.");
+  ScenarioStop (Seconds (10.0));
+  run.Run ();
+  run.Destroy (dumbbell.LeftCount () + dumbbell.RightCount () + 2);
+  SCENARIO_LOG_INFO ("Done.");
 
   std::cout << "+++++++++++++++++++++++++++++++++" <<std::endl; 
 
@@ -195,4 +234,18 @@ Ptr<UniformRandomVariable> randNumber = CreateObject<UniformRandomVariable> ();
      //std::cout << ",goodput," <<(bytesRcvd / 10-start_time[i]) << std::endl;
      std::cout << ",goodput," <<((sink2->GetTotalRx ())/( 10 - start_time[ii]))<< std::endl;
    }
+  cache.Store ();
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  // --batch=<file> or --batch=- runs one point per line in this process
+  std::string batch = FindBatchArgument (argc, argv);
+  if (batch.empty ())
+    {
+      return RunPoint (argc, argv);
+    }
+  return RunBatch (batch, argv[0], &RunPoint);
 }
@@ -35,12 +35,19 @@
 #include "ns3/netanim-module.h"
 #include "ns3/constant-position-mobility-model.h"
 
+#include "scenario-batch.h"
+#include "result-cache.h"
+#include "scenario-instrument.h"
+#include "scenario-telemetry.h"
+#include "topology-bench.h"
+
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE ("TcpBulkSendExample");
 
-int
-main (int argc, char *argv[])
+//One parameter point; the whole program unless --batch is given
+static int
+RunPoint (int argc, char *argv[])
 {
 
   bool tracing = false;
@@ -58,10 +65,11 @@ main (int argc, char *argv[])
   std::string queueType;
   std::string animFile= "p2-anim.xml"; 
   double load = 0.9;
+  bool instrument = false;
+  std::string eventProfile;
+  std::string benchTopology;
 
 
-  LogComponentEnable("TcpBulkSendExample", LOG_LEVEL_ALL);
-
 
 // Allow the user to override any of the defaults at
 // run-time, via command-line arguments
@@ -88,8 +96,13 @@ main (int argc, char *argv[])
   //cmd.AddValue ("segSize"  , "TCP Segment (Packet) Size "                   , segSize_Bytes);
   //cmd.AddValue ("tcpType"  , "TCP Flavour : Use 0 for Tahoe and 1 for Reno "         , tcpType);
   //cmd.AddValue ("nFlows"   , "Number of Simultaneous Flows "                , nFlows);
+  cmd.AddValue ("instrument", "Print phase wall times and event rates to stderr", instrument);
+  cmd.AddValue ("eventProfile", "Profile event callbacks: ranked table on stderr, folded stacks to this file", eventProfile);
+  cmd.AddValue ("benchTopology", "Micro-benchmark link setup at these comma-separated link counts and exit", benchTopology);
   
   cmd.Parse (argc, argv);
+  RunInstrument run ("p2", instrument, eventProfile);
+  StatusTelemetry status ("p2");  // progress file when SCENARIO_STATUS_FILE is set
 
 //
 // Set the parameters as per the command line inputs
@@ -118,6 +131,26 @@ main (int argc, char *argv[])
   Config::SetDefault ("ns3::RedQueue::QueueLimit", UintegerValue (qlen));
   Config::SetDefault ("ns3::RedQueue::LInterm", DoubleValue (maxP));
 
+  if (!benchTopology.empty ())
+    {
+      BenchLinks ("p2", benchTopology, queueType);
+      return 0;
+    }
+
+  // Skip the simulation when this exact point has been run before
+  ResultCache cache ("p2", argc, argv);
+  cache.AddOutputFile (animFile);
+  // Reports on stderr time this very run; traces would not be restored
+  if (tracing || instrument || !eventProfile.empty ())
+    {
+      cache.Bypass ("profiling or tracing");
+    }
+  if (cache.Replay ())
+    {
+      return 0;
+    }
+  run.Mark ("configuration");
+
 //
 // Explicitly create the nodes required by the topology (shown above).
 //
@@ -125,6 +158,7 @@ main (int argc, char *argv[])
    NodeContainer n;
    int numNodes = 5 + 4 + 5;
    n.Create(numNodes);
+   run.Mark ("nodes");
  
  
    //------------------------
@@ -253,21 +287,17 @@ main (int argc, char *argv[])
    // Create vector of NetDeviceContainer to loop through when assigning ip addresses
    NetDeviceContainer devsArray[] = {dc0c1, dc1c2, dc2c3, dc0l1, dc0l2, dc0l3, dc0l4, dc0l5, dc3r1, dc3r2, dc3r3, dc3r4, dc3r5};
    std::vector<NetDeviceContainer> devices(devsArray, devsArray + sizeof(devsArray) / sizeof(NetDeviceContainer));
+   run.Mark ("devices");
  
 
 
    //std::cerr << "Installing internet stack" << std::endl;
    InternetStackHelper stack;
    stack.Install (n);
+   run.Mark ("stack");
 
-  Ipv4AddressHelper ipv4;
-   std::vector<Ipv4InterfaceContainer> ifaceLinks(numNodes-1);
-   for(uint32_t i=0; i<devices.size(); ++i) {
-     std::ostringstream subnet;
-     subnet << "10.1." << i+1 << ".0";
-     ipv4.SetBase(subnet.str().c_str(), "255.255.255.0");
-     ifaceLinks[i] = ipv4.Assign(devices[i]);
-   }
+   std::vector<Ipv4InterfaceContainer> ifaceLinks = AssignLinkSubnets (devices);
+   run.Mark ("addresses");
 
 
    double bottleneckBW = 1000000; // bits per second
@@ -341,9 +371,10 @@ main (int argc, char *argv[])
    sinkApps.Start(Seconds(0.0));
    sinkApps.Stop(Seconds(10.0));
  
-   AnimationInterface animInterface(animFile);
-   animInterface.EnablePacketMetadata(true);
+   AnimationInterface *animInterface = new AnimationInterface(animFile);
+   animInterface->EnablePacketMetadata(true);
    //std::cerr << "\nSaving animation file: " << animFile << std::endl;
+   run.Mark ("applications");
  
 
 
@@ -355,15 +386,16 @@ main (int argc, char *argv[])
    // to tell nodes how to route packets. A routing table is the next top route
    // to the possible routing destinations.
    Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+   run.Mark ("routing");
  
  
    //---------------------
    //    RUN SIMULATION
    //---------------------
    //std::cout << "\nRuning simulation..." << std::endl;
-   Simulator::Stop (Seconds (10.0));
-   Simulator::Run ();
-   Simulator::Destroy ();
+   ScenarioStop (Seconds (10.0));
+   run.Run ();
+   run.Destroy (n.GetN ());
    std::cout << "\nSimulation finished!" << std::endl;
  
    std::cout << "queueType = " << queueType << "\n"
@@ -395,5 +427,19 @@ main (int argc, char *argv[])
      ++i;
    }
     std::cout <<"\n Overall goodput = " << float(total_bytes/10) << std::endl;
+   delete animInterface;  // completes the animation file before the cache stores it
+   cache.Store ();
    return 0;
 }
+
+int
+main (int argc, char *argv[])
+{
+  // --batch=<file> or --batch=- runs one point per line in this process
+  std::string batch = FindBatchArgument (argc, argv);
+  if (batch.empty ())
+    {
+      return RunPoint (argc, argv);
+    }
+  return RunBatch (batch, argv[0], &RunPoint);
+}
@@ -2,6 +2,19 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <vector>
+#include <map>
+#include <set>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <functional>
+#include <time.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "ns3/core-module.h"
 #include "ns3/aodv-module.h"
@@ -11,18 +24,570 @@
 #include "ns3/stats-module.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/wifi-module.h"
+#include "ns3/propagation-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/flow-monitor-helper.h"
+#include "ns3/ipv4-flow-classifier.h"
 #include "ns3/olsr-helper.h"
+#include "ns3/olsr-header.h"
+#include "ns3/olsr-routing-protocol.h"
+#include "ns3/aodv-packet.h"
 #include "ns3/ipv4-static-routing-helper.h"
 #include "ns3/ipv4-list-routing-helper.h"
+
+#include "worker-pool.h"
+#include "scenario-profile.h"
+#include "scenario-instrument.h"
+#include "scenario-telemetry.h"
+#include "micro-bench.h"
+#include "scenario-log.h"
+#include "timeseries.h"
+#include "result-cache.h"
 int j=0;
 
 
 using namespace ns3;
 NS_LOG_COMPONENT_DEFINE ("Teamx-ECE6110-p3");
 
-#define IEEE_80211_BANDWIDTH 20000000
+// Largest difference (dB) allowed between the batched received-power kernel
+// and LogDistancePropagationLossModel. The AVX2 path evaluates the logarithm
+// in single precision (about 2e-5 dB in practice); distances stay in double.
+#define RX_POWER_BATCH_TOLERANCE_DB 1e-3
+
+// Fixed RNG streams for the flow draw (--sinkDraw, 0 included), clear of
+// the streams LazyWaypointMobilityModel takes from 0 upwards. Being fixed,
+// the draw does not depend on how many objects were set up before it.
+#define SINK_DRAW_STREAM_BASE 1000000000
+
+static double WallSeconds (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//"0.1,0.2,0.5" -> {0.1, 0.2, 0.5}
+static std::vector<double> ParseDoubleList (const std::string &list)
+{
+    std::vector<double> values;
+    std::istringstream in (list);
+    std::string item;
+    while (std::getline (in, item, ','))
+        values.push_back (atof (item.c_str ()));
+    return values;
+}
+
+//Log-distance parameters, same meaning as LogDistancePropagationLossModel
+struct LogDistanceParams
+{
+    double exponent;
+    double referenceDistance;
+    double referenceLoss;
+};
+
+static LogDistanceParams DefaultLogDistanceParams (void)
+{
+    //Defaults of LogDistancePropagationLossModel, as used by YansWifiChannelHelper::Default
+    LogDistanceParams p;
+    p.exponent = 3.0;
+    p.referenceDistance = 1.0;
+    p.referenceLoss = 46.6777;
+    return p;
+}
+
+//Scalar received power for receivers (x[i], y[i]) from a sender at (sx, sy)
+static void BatchRxPowerScalar (const double *x, const double *y, uint32_t n,
+                                double sx, double sy, double txPowerDbm,
+                                const LogDistanceParams &p, double *rxPowerDbm)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        double dx = x[i] - sx;
+        double dy = y[i] - sy;
+        double distance = std::sqrt (dx * dx + dy * dy);
+        if (distance <= p.referenceDistance)
+        {
+            rxPowerDbm[i] = txPowerDbm;
+            continue;
+        }
+        double pathLossDb = 10 * p.exponent * std::log10 (distance / p.referenceDistance);
+        rxPowerDbm[i] = txPowerDbm - p.referenceLoss - pathLossDb;
+    }
+}
+
+#if defined(__AVX2__)
+//ln(r) for 8 positive floats: exponent extraction plus an atanh series on the mantissa
+static inline __m256 LogPs (__m256 r)
+{
+    __m256i bits = _mm256_castps_si256 (r);
+    __m256 e = _mm256_cvtepi32_ps (_mm256_sub_epi32 (_mm256_srli_epi32 (bits, 23), _mm256_set1_epi32 (127)));
+    __m256 one = _mm256_set1_ps (1.0f);
+    __m256 m = _mm256_castsi256_ps (_mm256_or_si256 (_mm256_and_si256 (bits, _mm256_set1_epi32 (0x007fffff)),
+                                                     _mm256_set1_epi32 (0x3f800000)));
+    __m256 t = _mm256_div_ps (_mm256_sub_ps (m, one), _mm256_add_ps (m, one));
+    __m256 t2 = _mm256_mul_ps (t, t);
+    __m256 s = _mm256_set1_ps (1.0f / 11);
+    s = _mm256_add_ps (_mm256_mul_ps (s, t2), _mm256_set1_ps (1.0f / 9));
+    s = _mm256_add_ps (_mm256_mul_ps (s, t2), _mm256_set1_ps (1.0f / 7));
+    s = _mm256_add_ps (_mm256_mul_ps (s, t2), _mm256_set1_ps (1.0f / 5));
+    s = _mm256_add_ps (_mm256_mul_ps (s, t2), _mm256_set1_ps (1.0f / 3));
+    s = _mm256_add_ps (_mm256_mul_ps (s, t2), one);
+    __m256 lnM = _mm256_mul_ps (_mm256_mul_ps (_mm256_set1_ps (2.0f), t), s);
+    return _mm256_add_ps (_mm256_mul_ps (e, _mm256_set1_ps (0.69314718f)), lnM);
+}
+
+//Squared distances for 4 receivers, in double to avoid cancellation on large grids
+static inline __m128 Distance2Ps (const double *x, const double *y, __m256d sx, __m256d sy)
+{
+    __m256d dx = _mm256_sub_pd (_mm256_loadu_pd (x), sx);
+    __m256d dy = _mm256_sub_pd (_mm256_loadu_pd (y), sy);
+    return _mm256_cvtpd_ps (_mm256_add_pd (_mm256_mul_pd (dx, dx), _mm256_mul_pd (dy, dy)));
+}
+#endif
+
+//Received power for n receivers at once; AVX2 when compiled in, scalar otherwise
+static void BatchRxPower (const double *x, const double *y, uint32_t n,
+                          double sx, double sy, double txPowerDbm,
+                          const LogDistanceParams &p, double *rxPowerDbm)
+{
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    // loss = 10 n log10 (d / d0) = (5 n / ln 10) ln (d^2 / d0^2)
+    __m256d vsx = _mm256_set1_pd (sx);
+    __m256d vsy = _mm256_set1_pd (sy);
+    __m256 invD02 = _mm256_set1_ps ((float)(1.0 / (p.referenceDistance * p.referenceDistance)));
+    __m256 lossScale = _mm256_set1_ps ((float)(5.0 * p.exponent / std::log (10.0)));
+    __m256 rxAtRef = _mm256_set1_ps ((float)(-p.referenceLoss));
+    __m256 one = _mm256_set1_ps (1.0f);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 d2 = _mm256_insertf128_ps (_mm256_castps128_ps256 (Distance2Ps (x + i, y + i, vsx, vsy)),
+                                          Distance2Ps (x + i + 4, y + i + 4, vsx, vsy), 1);
+        __m256 r = _mm256_mul_ps (d2, invD02);
+        __m256 rel = _mm256_sub_ps (rxAtRef, _mm256_mul_ps (lossScale, LogPs (r)));
+        // Inside the reference distance the model applies no loss at all
+        rel = _mm256_blendv_ps (rel, _mm256_setzero_ps (), _mm256_cmp_ps (r, one, _CMP_LE_OQ));
+        __m256d tx = _mm256_set1_pd (txPowerDbm);
+        _mm256_storeu_pd (rxPowerDbm + i, _mm256_add_pd (tx, _mm256_cvtps_pd (_mm256_castps256_ps128 (rel))));
+        _mm256_storeu_pd (rxPowerDbm + i + 4, _mm256_add_pd (tx, _mm256_cvtps_pd (_mm256_extractf128_ps (rel, 1))));
+    }
+#endif
+    BatchRxPowerScalar (x + i, y + i, n - i, sx, sy, txPowerDbm, p, rxPowerDbm + i);
+}
+
+//Straight-line leg of a lazily evaluated trajectory: position = start + velocity * (t - t0)
+struct MotionSegment
+{
+    double x0;
+    double y0;
+    double vx;
+    double vy;
+    double t0;   //s
+    double end;  //s, the leg holds for t < end
+};
+
+/**
+ * Random waypoint or random walk motion evaluated in closed form. The model
+ * schedules no events: a query at time t advances the trajectory leg by leg
+ * until it reaches the leg covering t and evaluates that leg directly.
+ * Random walk legs last WalkTime or until the bounds are reached, whichever
+ * is first; the next leg then draws a new direction. Course change traces
+ * are not fired.
+ */
+class LazyWaypointMobilityModel : public MobilityModel
+{
+public:
+    static TypeId GetTypeId (void);
+    LazyWaypointMobilityModel ();
+    MotionSegment GetSegment (void) const;
+
+private:
+    virtual Vector DoGetPosition (void) const;
+    virtual void DoSetPosition (const Vector &position);
+    virtual Vector DoGetVelocity (void) const;
+    virtual int64_t DoAssignStreams (int64_t stream);
+    void Advance (void) const;
+    void NextSegment (void) const;
+
+    bool m_walk;
+    double m_minSpeed;
+    double m_maxSpeed;
+    double m_pause;
+    double m_walkTime;
+    Rectangle m_bounds;
+    Ptr<UniformRandomVariable> m_uniform;
+    mutable MotionSegment m_segment;
+    mutable bool m_paused;  //current leg is a waypoint pause
+};
+
+NS_OBJECT_ENSURE_REGISTERED (LazyWaypointMobilityModel);
+
+TypeId LazyWaypointMobilityModel::GetTypeId (void)
+{
+    static TypeId tid = TypeId ("LazyWaypointMobilityModel")
+        .SetParent<MobilityModel> ()
+        .AddConstructor<LazyWaypointMobilityModel> ()
+        .AddAttribute ("Walk", "Random walk instead of random waypoint",
+                       BooleanValue (false),
+                       MakeBooleanAccessor (&LazyWaypointMobilityModel::m_walk),
+                       MakeBooleanChecker ())
+        .AddAttribute ("MinSpeed", "Lowest speed of a leg (m/s)",
+                       DoubleValue (0.5),
+                       MakeDoubleAccessor (&LazyWaypointMobilityModel::m_minSpeed),
+                       MakeDoubleChecker<double> (0.0))
+        .AddAttribute ("MaxSpeed", "Highest speed of a leg (m/s)",
+                       DoubleValue (5.0),
+                       MakeDoubleAccessor (&LazyWaypointMobilityModel::m_maxSpeed),
+                       MakeDoubleChecker<double> (0.0))
+        .AddAttribute ("Pause", "Pause at each waypoint (s)",
+                       DoubleValue (1.0),
+                       MakeDoubleAccessor (&LazyWaypointMobilityModel::m_pause),
+                       MakeDoubleChecker<double> (0.0))
+        .AddAttribute ("WalkTime", "Longest random walk leg (s)",
+                       DoubleValue (2.0),
+                       MakeDoubleAccessor (&LazyWaypointMobilityModel::m_walkTime),
+                       MakeDoubleChecker<double> (0.0))
+        .AddAttribute ("Bounds", "Area the node moves in",
+                       RectangleValue (Rectangle (0.0, 100.0, 0.0, 100.0)),
+                       MakeRectangleAccessor (&LazyWaypointMobilityModel::m_bounds),
+                       MakeRectangleChecker ());
+    return tid;
+}
+
+LazyWaypointMobilityModel::LazyWaypointMobilityModel () :
+m_uniform (CreateObject<UniformRandomVariable> ()),
+m_paused (false)
+{
+    m_segment.x0 = 0;
+    m_segment.y0 = 0;
+    m_segment.vx = 0;
+    m_segment.vy = 0;
+    m_segment.t0 = 0;
+    m_segment.end = 0;
+}
+
+//Start over from position at the current time
+void LazyWaypointMobilityModel::DoSetPosition (const Vector &position)
+{
+    m_segment.x0 = position.x;
+    m_segment.y0 = position.y;
+    m_segment.vx = 0;
+    m_segment.vy = 0;
+    m_segment.t0 = Simulator::Now ().GetSeconds ();
+    m_segment.end = m_segment.t0;
+    m_paused = true;  //so waypoint motion begins with a leg, not a pause
+}
+
+void LazyWaypointMobilityModel::Advance (void) const
+{
+    double now = Simulator::Now ().GetSeconds ();
+    while (now >= m_segment.end)
+        NextSegment ();
+}
+
+void LazyWaypointMobilityModel::NextSegment (void) const
+{
+    double t = m_segment.end;
+    double x = m_segment.x0 + m_segment.vx * (t - m_segment.t0);
+    double y = m_segment.y0 + m_segment.vy * (t - m_segment.t0);
+    double speed = m_uniform->GetValue (m_minSpeed, m_maxSpeed);
+    m_segment.x0 = x;
+    m_segment.y0 = y;
+    m_segment.t0 = t;
+    m_segment.vx = 0;
+    m_segment.vy = 0;
+
+    if (!m_walk && !m_paused && m_pause > 0)
+    {
+        m_segment.end = t + m_pause;
+        m_paused = true;
+        return;
+    }
+    m_paused = false;
+
+    double duration;
+    if (m_walk)
+    {
+        double angle = m_uniform->GetValue (0, 2 * M_PI);
+        m_segment.vx = speed * std::cos (angle);
+        m_segment.vy = speed * std::sin (angle);
+        // Stop at the first edge the leg would cross
+        duration = m_walkTime;
+        if (m_segment.vx > 0)
+            duration = std::min (duration, (m_bounds.xMax - x) / m_segment.vx);
+        else if (m_segment.vx < 0)
+            duration = std::min (duration, (m_bounds.xMin - x) / m_segment.vx);
+        if (m_segment.vy > 0)
+            duration = std::min (duration, (m_bounds.yMax - y) / m_segment.vy);
+        else if (m_segment.vy < 0)
+            duration = std::min (duration, (m_bounds.yMin - y) / m_segment.vy);
+    }
+    else
+    {
+        double dx = m_uniform->GetValue (m_bounds.xMin, m_bounds.xMax) - x;
+        double dy = m_uniform->GetValue (m_bounds.yMin, m_bounds.yMax) - y;
+        double distance = std::sqrt (dx * dx + dy * dy);
+        duration = speed > 0 ? distance / speed : m_pause;
+        if (duration > 0 && speed > 0)
+        {
+            m_segment.vx = dx / duration;
+            m_segment.vy = dy / duration;
+        }
+    }
+    // Never a zero-length leg, or Advance would not make progress
+    m_segment.end = t + std::max (duration, 1e-6);
+}
+
+MotionSegment LazyWaypointMobilityModel::GetSegment (void) const
+{
+    Advance ();
+    return m_segment;
+}
+
+Vector LazyWaypointMobilityModel::DoGetPosition (void) const
+{
+    Advance ();
+    double dt = Simulator::Now ().GetSeconds () - m_segment.t0;
+    return Vector (m_segment.x0 + m_segment.vx * dt, m_segment.y0 + m_segment.vy * dt, 0.0);
+}
+
+Vector LazyWaypointMobilityModel::DoGetVelocity (void) const
+{
+    Advance ();
+    return Vector (m_segment.vx, m_segment.vy, 0.0);
+}
+
+int64_t LazyWaypointMobilityModel::DoAssignStreams (int64_t stream)
+{
+    m_uniform->SetStream (stream);
+    return 1;
+}
+
+/**
+ * Log-distance loss model that evaluates a whole transmission at once.
+ * YansWifiChannel asks for one receiver at a time; on the first query of a
+ * transmission every known receiver is computed with BatchRxPower and the
+ * remaining queries are table lookups. Receiver positions are kept per
+ * trajectory leg: a batch moves every receiver along its current leg and
+ * only receivers whose leg has ended go back to their mobility model.
+ */
+class BatchLogDistancePropagationLossModel : public PropagationLossModel
+{
+public:
+    static TypeId GetTypeId (void);
+    BatchLogDistancePropagationLossModel ();
+
+private:
+    virtual double DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+    virtual int64_t DoAssignStreams (int64_t stream);
+    LogDistanceParams GetParams (void) const;
+    void Track (uint32_t index) const;
+    void RefreshPositions (void) const;
+
+    double m_exponent;
+    double m_referenceDistance;
+    double m_referenceLoss;
+
+    // Receivers in the order the channel queries them, positions as SoA
+    mutable std::vector<const MobilityModel *> m_receivers;
+    mutable std::map<const MobilityModel *, uint32_t> m_index;
+    mutable std::vector<double> m_x;
+    mutable std::vector<double> m_y;
+    mutable std::vector<double> m_rxPowerDbm;
+    mutable uint32_t m_cursor;
+
+    // Current leg of each receiver; static receivers hold one endless leg
+    typedef std::pair<double, uint32_t> Expiry;
+    mutable std::vector<MotionSegment> m_segments;
+    mutable std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry> > m_expiry;
+    mutable uint32_t m_mobile;
+
+    // Transmission the cached powers belong to
+    mutable const MobilityModel *m_sender;
+    mutable double m_txPowerDbm;
+    mutable Time m_batchTime;
+    mutable bool m_batchValid;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (BatchLogDistancePropagationLossModel);
+
+TypeId BatchLogDistancePropagationLossModel::GetTypeId (void)
+{
+    static TypeId tid = TypeId ("BatchLogDistancePropagationLossModel")
+        .SetParent<PropagationLossModel> ()
+        .AddConstructor<BatchLogDistancePropagationLossModel> ()
+        .AddAttribute ("Exponent", "The exponent of the Path Loss propagation model",
+                       DoubleValue (3.0),
+                       MakeDoubleAccessor (&BatchLogDistancePropagationLossModel::m_exponent),
+                       MakeDoubleChecker<double> ())
+        .AddAttribute ("ReferenceDistance", "The distance at which the reference loss is calculated (m)",
+                       DoubleValue (1.0),
+                       MakeDoubleAccessor (&BatchLogDistancePropagationLossModel::m_referenceDistance),
+                       MakeDoubleChecker<double> ())
+        .AddAttribute ("ReferenceLoss", "The reference loss at reference distance (dB)",
+                       DoubleValue (46.6777),
+                       MakeDoubleAccessor (&BatchLogDistancePropagationLossModel::m_referenceLoss),
+                       MakeDoubleChecker<double> ());
+    return tid;
+}
+
+BatchLogDistancePropagationLossModel::BatchLogDistancePropagationLossModel () :
+m_cursor (0),
+m_mobile (0),
+m_sender (0),
+m_txPowerDbm (0),
+m_batchValid (false)
+{
+}
+
+LogDistanceParams BatchLogDistancePropagationLossModel::GetParams (void) const
+{
+    LogDistanceParams p;
+    p.exponent = m_exponent;
+    p.referenceDistance = m_referenceDistance;
+    p.referenceLoss = m_referenceLoss;
+    return p;
+}
+
+//Take the current leg of receiver index from its mobility model
+void BatchLogDistancePropagationLossModel::Track (uint32_t index) const
+{
+    const LazyWaypointMobilityModel *lazy = dynamic_cast<const LazyWaypointMobilityModel *> (m_receivers[index]);
+    MotionSegment &seg = m_segments[index];
+    if (lazy)
+    {
+        seg = lazy->GetSegment ();
+        m_expiry.push (Expiry (seg.end, index));
+    }
+    else
+    {
+        Vector pos = m_receivers[index]->GetPosition ();
+        seg.x0 = pos.x;
+        seg.y0 = pos.y;
+        seg.vx = 0;
+        seg.vy = 0;
+        seg.t0 = 0;
+        seg.end = std::numeric_limits<double>::infinity ();
+    }
+}
+
+void BatchLogDistancePropagationLossModel::RefreshPositions (void) const
+{
+    if (m_mobile == 0)
+        return;
+    double now = Simulator::Now ().GetSeconds ();
+    while (!m_expiry.empty () && m_expiry.top ().first <= now)
+    {
+        uint32_t index = m_expiry.top ().second;
+        m_expiry.pop ();
+        Track (index);
+    }
+    for (uint32_t i = 0; i < m_receivers.size (); i++)
+    {
+        const MotionSegment &seg = m_segments[i];
+        m_x[i] = seg.x0 + seg.vx * (now - seg.t0);
+        m_y[i] = seg.y0 + seg.vy * (now - seg.t0);
+    }
+}
+
+double BatchLogDistancePropagationLossModel::DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a,
+                                                            Ptr<MobilityModel> b) const
+{
+    const MobilityModel *receiver = PeekPointer (b);
+    uint32_t index;
+    if (m_cursor < m_receivers.size () && m_receivers[m_cursor] == receiver)
+    {
+        index = m_cursor;
+    }
+    else
+    {
+        std::map<const MobilityModel *, uint32_t>::const_iterator it = m_index.find (receiver);
+        if (it == m_index.end ())
+        {
+            // First time we hear of this receiver: answer directly and
+            // include it in the next batch
+            Vector pos = b->GetPosition ();
+            m_index[receiver] = m_receivers.size ();
+            m_receivers.push_back (receiver);
+            m_x.push_back (pos.x);
+            m_y.push_back (pos.y);
+            m_segments.push_back (MotionSegment ());
+            if (dynamic_cast<const LazyWaypointMobilityModel *> (receiver))
+                m_mobile++;
+            Track (m_receivers.size () - 1);
+            m_batchValid = false;
+            double rx;
+            Vector s = a->GetPosition ();
+            BatchRxPowerScalar (&pos.x, &pos.y, 1, s.x, s.y, txPowerDbm, GetParams (), &rx);
+            return rx;
+        }
+        index = it->second;
+    }
+    m_cursor = index + 1;
+
+    if (!m_batchValid || m_sender != PeekPointer (a) || m_txPowerDbm != txPowerDbm
+        || m_batchTime != Simulator::Now ())
+    {
+        RefreshPositions ();
+        Vector s = a->GetPosition ();
+        m_rxPowerDbm.resize (m_receivers.size ());
+        BatchRxPower (&m_x[0], &m_y[0], m_receivers.size (), s.x, s.y, txPowerDbm, GetParams (), &m_rxPowerDbm[0]);
+        m_sender = PeekPointer (a);
+        m_txPowerDbm = txPowerDbm;
+        m_batchTime = Simulator::Now ();
+        m_batchValid = true;
+    }
+    return m_rxPowerDbm[index];
+}
+
+int64_t BatchLogDistancePropagationLossModel::DoAssignStreams (int64_t stream)
+{
+    return 0;
+}
+
+//Micro-benchmark of the batched kernel against the scalar path
+static void BenchRxPower (uint32_t numReceivers)
+{
+    LogDistanceParams p = DefaultLogDistanceParams ();
+
+    Ptr<UniformRandomVariable> uv = CreateObject<UniformRandomVariable> ();
+    uv->SetAttribute ("Max", DoubleValue (30000.0));
+    std::vector<double> x (numReceivers), y (numReceivers);
+    for (uint32_t i = 0; i < numReceivers; i++)
+    {
+        x[i] = uv->GetValue ();
+        y[i] = uv->GetValue ();
+    }
+    std::vector<double> scalar (numReceivers), batch (numReceivers);
+    uint32_t reps = 1 + 100000000 / numReceivers;
+
+    double start = WallSeconds ();
+    for (uint32_t r = 0; r < reps; r++)
+        BatchRxPowerScalar (&x[0], &y[0], numReceivers, x[r % numReceivers], y[r % numReceivers], 27.0, p, &scalar[0]);
+    double scalarNs = (WallSeconds () - start) * 1e9;
+
+    start = WallSeconds ();
+    for (uint32_t r = 0; r < reps; r++)
+        BatchRxPower (&x[0], &y[0], numReceivers, x[r % numReceivers], y[r % numReceivers], 27.0, p, &batch[0]);
+    double batchNs = (WallSeconds () - start) * 1e9;
+
+    double maxDiff = 0;
+    for (uint32_t i = 0; i < numReceivers; i++)
+        maxDiff = std::max (maxDiff, std::fabs (scalar[i] - batch[i]));
+
+    double total = (double) reps * numReceivers;
+#if defined(__AVX2__)
+    std::cout << "kernel,avx2";
+#else
+    std::cout << "kernel,scalar";
+#endif
+    std::cout << ",receivers,"             << numReceivers;
+    std::cout << ",scalar(rx/ns),"         << total / scalarNs;
+    std::cout << ",batch(rx/ns),"          << total / batchNs;
+    std::cout << ",maxDiff(dB),"           << maxDiff;
+    std::cout << ",tolerance(dB),"         << RX_POWER_BATCH_TOLERANCE_DB << std::endl;
+    NS_ABORT_MSG_IF (maxDiff > RX_POWER_BATCH_TOLERANCE_DB, "Batched received power outside tolerance");
+}
 
 //Function to send traffic
 static void GenerateTraffic (Ptr<Socket> socket, uint32_t pktSize,
@@ -42,28 +607,714 @@ static void GenerateTraffic (Ptr<Socket> socket, uint32_t pktSize,
     }
 }
 
+//Distance (m) at which log-distance received power drops to thresholdDbm
+static double RadioRange (double txPowerDbm, double thresholdDbm, const LogDistanceParams &p)
+{
+    return p.referenceDistance * std::pow (10.0, (txPowerDbm - p.referenceLoss - thresholdDbm) / (10 * p.exponent));
+}
+
+//Neighbour lists of nodes within range of each other, using cells of side range
+static void BuildNeighbours (const std::vector<double> &x, const std::vector<double> &y, double range,
+                             std::vector<std::vector<uint32_t> > &neighbours)
+{
+    typedef std::pair<int64_t, int64_t> Cell;
+    std::map<Cell, std::vector<uint32_t> > cells;
+    for (uint32_t i = 0; i < x.size (); i++)
+        cells[Cell ((int64_t) std::floor (x[i] / range), (int64_t) std::floor (y[i] / range))].push_back (i);
+
+    neighbours.assign (x.size (), std::vector<uint32_t> ());
+    double range2 = range * range;
+    for (uint32_t i = 0; i < x.size (); i++)
+    {
+        int64_t cx = (int64_t) std::floor (x[i] / range);
+        int64_t cy = (int64_t) std::floor (y[i] / range);
+        for (int64_t gx = cx - 1; gx <= cx + 1; gx++)
+        {
+            for (int64_t gy = cy - 1; gy <= cy + 1; gy++)
+            {
+                std::map<Cell, std::vector<uint32_t> >::const_iterator it = cells.find (Cell (gx, gy));
+                if (it == cells.end ())
+                    continue;
+                for (uint32_t k = 0; k < it->second.size (); k++)
+                {
+                    uint32_t j = it->second[k];
+                    double dx = x[j] - x[i];
+                    double dy = y[j] - y[i];
+                    if (j != i && dx * dx + dy * dy <= range2)
+                        neighbours[i].push_back (j);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Constant-bit-rate driver for all periodic UDP sources of the experiment.
+ * Pending sends sit in a hashed timing wheel: WHEEL_SLOTS buckets, one per
+ * tick, indexed by tick % WHEEL_SLOTS, where a tick is the interval of the
+ * first source. Rescheduling a source one interval ahead is then an append
+ * to the next bucket. Sends more than one rotation away (the first send of
+ * each source, usually) wait in an ordered overflow list and move into the
+ * wheel as it turns. Only the earliest send has an event in the simulator
+ * queue. Send times follow GenerateTraffic exactly: pktCount sends at
+ * start + k * interval, then the socket is closed one interval later.
+ * Each send copies one shared zero-filled packet per size.
+ */
+class PeriodicTrafficWheel
+{
+public:
+    PeriodicTrafficWheel ();
+    void AddSource (Ptr<Socket> socket, uint32_t pktSize, uint32_t pktCount, Time start, Time interval);
+    uint64_t GetEventCount (void) const;
+    uint64_t GetLegacyEventCount (void) const;
+
+private:
+    enum { WHEEL_SLOTS = 256 };
+    struct Source
+    {
+        Ptr<Socket> socket;
+        Ptr<Packet> packet;
+        uint32_t remaining;
+        Time interval;
+    };
+    struct Entry
+    {
+        Time when;
+        uint32_t source;
+    };
+    int64_t TickOf (Time t) const;
+    void Insert (Time when, uint32_t source);
+    void Advance (int64_t tick);
+    void Arm (void);
+    void Fire (void);
+
+    std::vector<Source> m_sources;
+    std::vector<std::vector<Entry> > m_wheel;
+    std::multimap<Time, uint32_t> m_overflow;
+    std::map<uint32_t, Ptr<Packet> > m_templates;
+    int64_t m_tickSteps;              // tick width in time steps
+    int64_t m_cursor;                 // tick of the first wheel slot
+    uint32_t m_pending;               // entries in the wheel
+    EventId m_event;
+    Time m_armedAt;
+    uint64_t m_events;
+    uint64_t m_legacyEvents;
+};
+
+PeriodicTrafficWheel::PeriodicTrafficWheel () :
+m_wheel (WHEEL_SLOTS),
+m_tickSteps (0),
+m_cursor (0),
+m_pending (0),
+m_events (0),
+m_legacyEvents (0)
+{
+}
+
+int64_t PeriodicTrafficWheel::TickOf (Time t) const
+{
+    return t.GetTimeStep () / m_tickSteps;
+}
+
+//Sources due at one instant keep the order they were inserted in
+void PeriodicTrafficWheel::Insert (Time when, uint32_t source)
+{
+    int64_t tick = TickOf (when);
+    if (tick >= m_cursor + WHEEL_SLOTS) {
+        m_overflow.insert (std::make_pair (when, source));
+        return;
+    }
+    Entry e;
+    e.when = when;
+    e.source = source;
+    m_wheel[tick % WHEEL_SLOTS].push_back (e);
+    m_pending++;
+}
+
+//Turn the wheel to tick (only ever the current time's), pulling overflow entries that now fit
+void PeriodicTrafficWheel::Advance (int64_t tick)
+{
+    if (tick <= m_cursor)
+        return;
+    m_cursor = tick;
+    while (!m_overflow.empty () && TickOf (m_overflow.begin ()->first) < m_cursor + WHEEL_SLOTS) {
+        std::multimap<Time, uint32_t>::iterator first = m_overflow.begin ();
+        Entry e;
+        e.when = first->first;
+        e.source = first->second;
+        m_wheel[TickOf (e.when) % WHEEL_SLOTS].push_back (e);
+        m_pending++;
+        m_overflow.erase (first);
+    }
+}
+
+void PeriodicTrafficWheel::AddSource (Ptr<Socket> socket, uint32_t pktSize, uint32_t pktCount, Time start, Time interval)
+{
+    if (m_templates.find (pktSize) == m_templates.end ())
+        m_templates[pktSize] = Create<Packet> (pktSize);
+    if (m_tickSteps == 0) {
+        m_tickSteps = std::max (interval.GetTimeStep (), (int64_t) 1);
+        m_cursor = TickOf (Simulator::Now ());
+    }
+
+    Source src;
+    src.socket = socket;
+    src.packet = m_templates[pktSize];
+    src.remaining = pktCount;
+    src.interval = interval;
+    Insert (Simulator::Now () + start, m_sources.size ());
+    m_sources.push_back (src);
+
+    // GenerateTraffic would schedule one event per packet plus the close
+    m_legacyEvents += (uint64_t) pktCount + 1;
+    Arm ();
+}
+
+//Keep exactly one event pending, for the earliest send
+void PeriodicTrafficWheel::Arm (void)
+{
+    Time next;
+    if (m_pending == 0) {
+        // Overflow entries are all later than anything in the wheel
+        if (m_overflow.empty ())
+            return;
+        next = m_overflow.begin ()->first;
+    } else {
+        // The first non-empty slot holds a single tick; its earliest entry is next
+        const std::vector<Entry> *slot = 0;
+        for (int64_t tick = m_cursor; !slot; tick++) {
+            if (!m_wheel[tick % WHEEL_SLOTS].empty ())
+                slot = &m_wheel[tick % WHEEL_SLOTS];
+        }
+        next = (*slot)[0].when;
+        for (uint32_t k = 1; k < slot->size (); k++)
+            next = std::min (next, (*slot)[k].when);
+    }
+
+    if (m_event.IsRunning ()) {
+        if (m_armedAt <= next)
+            return;
+        m_event.Cancel ();
+    }
+    m_armedAt = next;
+    m_event = Simulator::Schedule (next - Simulator::Now (), &PeriodicTrafficWheel::Fire, this);
+    m_events++;
+}
+
+void PeriodicTrafficWheel::Fire (void)
+{
+    Time now = Simulator::Now ();
+    Advance (TickOf (now));
+    std::vector<Entry> &slot = m_wheel[m_cursor % WHEEL_SLOTS];
+    std::vector<uint32_t> due;
+    uint32_t kept = 0;
+    for (uint32_t k = 0; k < slot.size (); k++) {
+        if (slot[k].when == now)
+            due.push_back (slot[k].source);
+        else
+            slot[kept++] = slot[k];
+    }
+    slot.resize (kept);
+    m_pending -= due.size ();
+
+    // Sources due now are served in the order GenerateTraffic events would run
+    for (uint32_t k = 0; k < due.size (); k++)
+    {
+        Source &src = m_sources[due[k]];
+        if (src.remaining > 0)
+        {
+            src.socket->Send (src.packet->Copy ());
+            src.remaining--;
+            Insert (now + src.interval, due[k]);
+        }
+        else
+        {
+            src.socket->Close ();
+            src.socket = 0;
+        }
+    }
+    Arm ();
+}
+
+uint64_t PeriodicTrafficWheel::GetEventCount (void) const
+{
+    return m_events;
+}
+
+uint64_t PeriodicTrafficWheel::GetLegacyEventCount (void) const
+{
+    return m_legacyEvents;
+}
+
+/**
+ * Routing control overhead by message type, plus MAC retries and drops.
+ * Every IPv4 transmission is classified from the first bytes of the packet;
+ * only packets on the OLSR or AODV port are parsed any further.
+ */
+class ControlOverhead
+{
+public:
+    enum Type
+    {
+        OLSR_HELLO, OLSR_TC, OLSR_OTHER,
+        AODV_RREQ, AODV_RREP, AODV_RERR, AODV_HELLO, AODV_RREP_ACK,
+        NUM_TYPES
+    };
+    ControlOverhead ();
+    void Install (void);
+    void Print (std::ostream &os) const;
+
+private:
+    void Ipv4Tx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+    void ParseOlsr (Ptr<Packet> payload);
+    void ParseAodv (Ptr<Packet> payload, Ipv4Address destination);
+    void Count (Type type, uint32_t bytes);
+    void MacTxDataFailed (Mac48Address address);
+    void MacTxFinalDataFailed (Mac48Address address);
+    void MacTxDrop (Ptr<const Packet> packet);
+
+    uint64_t m_packets[NUM_TYPES];
+    uint64_t m_bytes[NUM_TYPES];
+    uint64_t m_controlIpPackets;
+    uint64_t m_controlIpBytes;
+    uint64_t m_macRetries;
+    uint64_t m_macRetryDrops;
+    uint64_t m_macQueueDrops;
+};
+
+static const char *g_controlTypeNames[ControlOverhead::NUM_TYPES] =
+{
+    "olsrHello", "olsrTc", "olsrOther",
+    "aodvRreq", "aodvRrep", "aodvRerr", "aodvHello", "aodvRrepAck"
+};
+
+#define OLSR_PORT 698
+#define AODV_PORT 654
+
+ControlOverhead::ControlOverhead () :
+m_controlIpPackets (0),
+m_controlIpBytes (0),
+m_macRetries (0),
+m_macRetryDrops (0),
+m_macQueueDrops (0)
+{
+    std::fill (m_packets, m_packets + NUM_TYPES, 0);
+    std::fill (m_bytes, m_bytes + NUM_TYPES, 0);
+}
+
+void ControlOverhead::Install (void)
+{
+    Config::ConnectWithoutContext ("/NodeList/*/$ns3::Ipv4L3Protocol/Tx",
+                                   MakeCallback (&ControlOverhead::Ipv4Tx, this));
+    Config::ConnectWithoutContext ("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/RemoteStationManager/MacTxDataFailed",
+                                   MakeCallback (&ControlOverhead::MacTxDataFailed, this));
+    Config::ConnectWithoutContext ("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/RemoteStationManager/MacTxFinalDataFailed",
+                                   MakeCallback (&ControlOverhead::MacTxFinalDataFailed, this));
+    Config::ConnectWithoutContext ("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Mac/MacTxDrop",
+                                   MakeCallback (&ControlOverhead::MacTxDrop, this));
+}
+
+void ControlOverhead::Ipv4Tx (Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+    // Protocol and UDP destination port straight from the serialized headers
+    uint8_t head[28];
+    if (packet->CopyData (head, sizeof (head)) < sizeof (head) || head[9] != UdpL4Protocol::PROT_NUMBER)
+        return;
+    uint32_t ihl = (head[0] & 0x0f) * 4;
+    if (ihl + 4 > sizeof (head))
+        return;
+    uint16_t port = (head[ihl + 2] << 8) | head[ihl + 3];
+    if (port != OLSR_PORT && port != AODV_PORT)
+        return;
+
+    m_controlIpPackets++;
+    m_controlIpBytes += packet->GetSize ();
+    Ptr<Packet> payload = packet->Copy ();
+    Ipv4Header ipHeader;
+    UdpHeader udpHeader;
+    payload->RemoveHeader (ipHeader);
+    payload->RemoveHeader (udpHeader);
+    if (port == OLSR_PORT)
+        ParseOlsr (payload);
+    else
+        ParseAodv (payload, ipHeader.GetDestination ());
+}
+
+void ControlOverhead::ParseOlsr (Ptr<Packet> payload)
+{
+    olsr::PacketHeader packetHeader;
+    payload->RemoveHeader (packetHeader);
+    while (payload->GetSize () > 0)
+    {
+        olsr::MessageHeader message;
+        if (payload->RemoveHeader (message) == 0)
+            break;
+        switch (message.GetMessageType ())
+        {
+        case olsr::MessageHeader::HELLO_MESSAGE:
+            Count (OLSR_HELLO, message.GetSerializedSize ());
+            break;
+        case olsr::MessageHeader::TC_MESSAGE:
+            Count (OLSR_TC, message.GetSerializedSize ());
+            break;
+        default:
+            Count (OLSR_OTHER, message.GetSerializedSize ());
+            break;
+        }
+    }
+}
+
+void ControlOverhead::ParseAodv (Ptr<Packet> payload, Ipv4Address destination)
+{
+    aodv::TypeHeader typeHeader;
+    payload->PeekHeader (typeHeader);
+    if (!typeHeader.IsValid ())
+        return;
+    uint32_t bytes = payload->GetSize ();
+    switch (typeHeader.Get ())
+    {
+    case aodv::AODVTYPE_RREQ:
+        Count (AODV_RREQ, bytes);
+        break;
+    case aodv::AODVTYPE_RREP:
+        // Hellos are RREPs sent to the broadcast address
+        if (destination.IsBroadcast () || destination.IsSubnetDirectedBroadcast (Ipv4Mask ("255.255.0.0")))
+            Count (AODV_HELLO, bytes);
+        else
+            Count (AODV_RREP, bytes);
+        break;
+    case aodv::AODVTYPE_RERR:
+        Count (AODV_RERR, bytes);
+        break;
+    case aodv::AODVTYPE_RREP_ACK:
+        Count (AODV_RREP_ACK, bytes);
+        break;
+    }
+}
+
+void ControlOverhead::Count (Type type, uint32_t bytes)
+{
+    m_packets[type]++;
+    m_bytes[type] += bytes;
+}
+
+void ControlOverhead::MacTxDataFailed (Mac48Address address)
+{
+    m_macRetries++;
+}
+
+void ControlOverhead::MacTxFinalDataFailed (Mac48Address address)
+{
+    m_macRetryDrops++;
+}
+
+void ControlOverhead::MacTxDrop (Ptr<const Packet> packet)
+{
+    m_macQueueDrops++;
+}
+
+void ControlOverhead::Print (std::ostream &os) const
+{
+    os << ",ctrlPackets," << m_controlIpPackets;
+    os << ",ctrlBytes,"   << m_controlIpBytes;
+    for (uint32_t t = 0; t < NUM_TYPES; t++)
+    {
+        os << "," << g_controlTypeNames[t] << "Msgs,"  << m_packets[t];
+        os << "," << g_controlTypeNames[t] << "Bytes," << m_bytes[t];
+    }
+    os << ",macRetries,"    << m_macRetries;
+    os << ",macRetryDrops," << m_macRetryDrops;
+    os << ",macQueueDrops," << m_macQueueDrops;
+}
+
+/**
+ * P-square estimate of one quantile (Jain and Chlamtac, 1985): five markers
+ * whose heights are nudged with a parabolic fit as samples arrive, so the
+ * memory stays constant however long the run is.
+ */
+class P2Quantile
+{
+public:
+    explicit P2Quantile (double p);
+    void Add (double x);
+    double Get (void) const;
+
+private:
+    double Parabolic (int i, int d) const;
+    double Linear (int i, int d) const;
+
+    double m_p;
+    uint32_t m_count;
+    double m_q[5];   //marker heights
+    double m_n[5];   //marker positions
+    double m_np[5];  //desired positions
+    double m_dn[5];  //desired position increments
+};
+
+P2Quantile::P2Quantile (double p) :
+m_p (p),
+m_count (0)
+{
+    m_dn[0] = 0; m_dn[1] = p / 2; m_dn[2] = p; m_dn[3] = (1 + p) / 2; m_dn[4] = 1;
+    for (int i = 0; i < 5; i++)
+    {
+        m_q[i] = 0;
+        m_n[i] = i;
+        m_np[i] = 4 * m_dn[i];
+    }
+}
+
+void P2Quantile::Add (double x)
+{
+    if (m_count < 5)
+    {
+        m_q[m_count++] = x;
+        if (m_count == 5)
+            std::sort (m_q, m_q + 5);
+        return;
+    }
+    m_count++;
+
+    int k;
+    if (x < m_q[0])
+    {
+        m_q[0] = x;
+        k = 0;
+    }
+    else if (x >= m_q[4])
+    {
+        m_q[4] = x;
+        k = 3;
+    }
+    else
+    {
+        k = 0;
+        while (x >= m_q[k + 1])
+            k++;
+    }
+    for (int i = k + 1; i < 5; i++)
+        m_n[i]++;
+    for (int i = 0; i < 5; i++)
+        m_np[i] += m_dn[i];
+
+    for (int i = 1; i < 4; i++)
+    {
+        double d = m_np[i] - m_n[i];
+        if ((d >= 1 && m_n[i + 1] - m_n[i] > 1) || (d <= -1 && m_n[i - 1] - m_n[i] < -1))
+        {
+            int s = d > 0 ? 1 : -1;
+            double q = Parabolic (i, s);
+            if (q <= m_q[i - 1] || q >= m_q[i + 1])
+                q = Linear (i, s);
+            m_q[i] = q;
+            m_n[i] += s;
+        }
+    }
+}
+
+double P2Quantile::Parabolic (int i, int d) const
+{
+    return m_q[i] + d / (m_n[i + 1] - m_n[i - 1]) *
+           ((m_n[i] - m_n[i - 1] + d) * (m_q[i + 1] - m_q[i]) / (m_n[i + 1] - m_n[i]) +
+            (m_n[i + 1] - m_n[i] - d) * (m_q[i] - m_q[i - 1]) / (m_n[i] - m_n[i - 1]));
+}
+
+double P2Quantile::Linear (int i, int d) const
+{
+    return m_q[i] + d * (m_q[i + d] - m_q[i]) / (m_n[i + d] - m_n[i]);
+}
+
+//Exact for fewer than five samples (nearest rank), the middle marker after that
+double P2Quantile::Get (void) const
+{
+    if (m_count == 0)
+        return 0;
+    if (m_count < 5)
+    {
+        double sorted[5];
+        std::copy (m_q, m_q + m_count, sorted);
+        std::sort (sorted, sorted + m_count);
+        return sorted[(uint32_t) (m_p * (m_count - 1) + 0.5)];
+    }
+    return m_q[2];
+}
+
+//Per-interval throughput file: text, or columnar (timeseries.h) for a .tsc name,
+//including the .tsc.run<k>/.component<k>/.variant<k> names of split runs
+class ThroughputSeries : public SimpleRefCount<ThroughputSeries>
+{
+public:
+    ThroughputSeries (std::string fileName);
+    void Add (double time, double mbs);
+
+private:
+    std::ofstream m_text;
+    TimeSeriesWriter m_columns;
+};
+
+ThroughputSeries::ThroughputSeries (std::string fileName)
+{
+    bool columnar = fileName.find (".tsc.") != std::string::npos
+        || (fileName.size () > 4 && fileName.compare (fileName.size () - 4, 4, ".tsc") == 0);
+    if (columnar) {
+        m_columns.Open (fileName, std::vector<std::string> (1, "throughput(Mbs)"));
+        return;
+    }
+    m_text.open (fileName.c_str ());
+    m_text << "#time(s) throughput(Mbs)\n";
+}
+
+void ThroughputSeries::Add (double time, double mbs)
+{
+    if (m_columns.IsOpen ())
+        m_columns.Append (Seconds (time).GetNanoSeconds (), &mbs);
+    else
+        m_text << time << " " << mbs << "\n";
+}
+
+/**
+ * Per-interval received throughput summarised online: count, mean and
+ * variance (Welford), extremes and P-square quantiles. Optionally every
+ * interval is also streamed to a file (ThroughputSeries).
+ */
+class ThroughputStats
+{
+public:
+    ThroughputStats ();
+    void Open (std::string fileName);
+    void Close ();
+    void Add (double time, double mbs);
+    void Print (std::ostream &os) const;
+
+private:
+    uint64_t m_count;
+    double m_mean;
+    double m_m2;
+    double m_min;
+    double m_max;
+    P2Quantile m_p5;
+    P2Quantile m_p50;
+    P2Quantile m_p95;
+    Ptr<ThroughputSeries> m_file;  //shared, so the experiment stays assignable
+};
+
+ThroughputStats::ThroughputStats () :
+m_count (0),
+m_mean (0),
+m_m2 (0),
+m_min (0),
+m_max (0),
+m_p5 (0.05),
+m_p50 (0.5),
+m_p95 (0.95)
+{
+}
+
+void ThroughputStats::Open (std::string fileName)
+{
+    m_file = Create<ThroughputSeries> (fileName);
+}
+
+//Flushes the file; copies sharing it keep it open until the last one goes
+void ThroughputStats::Close ()
+{
+    m_file = 0;
+}
+
+void ThroughputStats::Add (double time, double mbs)
+{
+    m_count++;
+    double delta = mbs - m_mean;
+    m_mean += delta / m_count;
+    m_m2 += delta * (mbs - m_mean);
+    m_min = (m_count == 1 || mbs < m_min) ? mbs : m_min;
+    m_max = (m_count == 1 || mbs > m_max) ? mbs : m_max;
+    m_p5.Add (mbs);
+    m_p50.Add (mbs);
+    m_p95.Add (mbs);
+    if (m_file)
+        m_file->Add (time, mbs);
+}
+
+void ThroughputStats::Print (std::ostream &os) const
+{
+    os << ",tputIntervals,"   << m_count;
+    os << ",tputMean(Mbs),"   << m_mean;
+    os << ",tputStd(Mbs),"    << (m_count > 1 ? std::sqrt (m_m2 / (m_count - 1)) : 0.0);
+    os << ",tputMin(Mbs),"    << m_min;
+    os << ",tputP5(Mbs),"     << m_p5.Get ();
+    os << ",tputMedian(Mbs)," << m_p50.Get ();
+    os << ",tputP95(Mbs),"    << m_p95.Get ();
+    os << ",tputMax(Mbs),"    << m_max;
+}
+
+//Nodes (global grid indices) and flows (indices into nodes) of one radio-connected component
+struct ComponentPlan
+{
+    std::vector<uint32_t> nodes;
+    std::vector<std::pair<uint32_t, uint32_t> > flows;
+};
+
 class AdHocExperiment
 {
 public:
     
     AdHocExperiment ();
     AdHocExperiment (double nodeDensity, double txp, uint32_t protocol, double intensity, double onTime, double offTime);
-    Gnuplot2dDataset Run (const WifiHelper &wifi, const YansWifiPhyHelper &wifiPhy,
-                          const NqosWifiMacHelper &wifiMac, const YansWifiChannelHelper &wifiChannel, const MobilityHelper &mobility);
+    void Run (const WifiHelper &wifi, const YansWifiPhyHelper &wifiPhy,
+                          const WifiMacHelper &wifiMac, const YansWifiChannelHelper &wifiChannel, const MobilityHelper &mobility);
     
     bool CommandSetup (int argc, char **argv);
     double CheckEfficiency();
+    double GetThroughputMbs () const;
+    void SetTrafficWheel (bool enable);
+    void EnableFlowMonitor (double sampleFraction, std::string fileName);
+    void SetComponent (const ComponentPlan &plan);
+    void EnableSetupProfile ();
+    void EnableRunRecord ();
+    void EnableEventProfile (std::string foldedFile);
+    void SetChannelWidth (uint32_t widthMhz);
+    void SetThroughputSampling (double interval, std::string fileName);
+    void EnableMemoryReport (double interval);
+    void SetMobility (std::string model, double minSpeed, double maxSpeed, double pause);
+    void SetSinkDraw (uint32_t draw);
+    void EnableWarmStart (const std::vector<double> &intensities, const std::vector<double> &sinkDraws);
+    const std::vector<SetupProfile::Phase> &GetSetupPhases () const;
+    uint32_t GetSimulatedNodes () const;
+    uint32_t PlanComponents (double rangeM, std::vector<ComponentPlan> &plans);
+    void SetFlowsOnly ();
+    const std::vector<std::pair<uint32_t, uint32_t> > &GetFlows () const;
+    uint64_t GetRecvBytes () const;
+    uint64_t GetSentBytes () const;
+    uint64_t GetOfferedBytesPerSource () const;
+    double GetNetworkCapacity () const;
     
 private:
-    void ApplicationSetup (Ptr<Node> client, Ptr<Node> server, double start, double stop, uint64_t dataRate);
-    void SelectSrcDest (NodeContainer c, uint64_t dataRate);
+    uint32_t GetNumNodes () const;
+    Vector GetGridPosition (uint32_t index) const;
+    std::vector<std::pair<uint32_t, uint32_t> > DrawFlows (uint32_t totalNodes) const;
+    void ApplicationSetup (Ptr<Node> client, Ptr<Node> server, Ipv4Address serverAddress,
+                           double start, double stop, uint64_t dataRate);
+    void SelectSrcDest (const NodeContainer &c, uint64_t dataRate);
     void ReceivePacket (Ptr<Socket> socket);
     void SendPacket (Ptr<Socket> socket, uint32_t dataSent);
 
 
     void CheckThroughput ();
+    void SampleMemory (NodeContainer c);
+    bool WarmStart (double setupStart);
+    bool IsFlowSampled (uint32_t flow) const;
+    void PopulateOracleRoutes (NodeContainer c, const Ipv4InterfaceContainer &interfaces, double rangeM);
+    Ptr<FlowMonitor> InstallFlowMonitor (FlowMonitorHelper &helper, NodeContainer c);
+    void WriteFlowStats (Ptr<FlowMonitor> flowmon, FlowMonitorHelper &helper, NodeContainer c);
     
-    Gnuplot2dDataset m_output;
+    ThroughputStats m_throughput;
+    PeriodicTrafficWheel m_traffic;
+    ControlOverhead m_overhead;
+    std::vector<std::pair<uint32_t, uint32_t> > m_flows; //(source, destination) node indices
+    std::vector<uint32_t> m_nodeIndices;                 //grid indices simulated here, empty = all
+    Ipv4InterfaceContainer m_interfaces;
+    SetupProfile m_profile;
     
     double m_totalTime;
     double m_intensity;
@@ -71,15 +1322,46 @@ private:
     double m_offTime;
     double m_txp;
 
-    uint32_t m_SentBytesTotal;
-    uint32_t m_RecvBytesTotal;
+    uint64_t m_SentBytesTotal;
+    uint64_t m_RecvBytesTotal;
     uint32_t m_packetSize;
     uint32_t m_gridSize;
     uint32_t m_nodeDistance;
     uint32_t m_port;
     double m_nodeDensity;
     uint32_t m_protocol;
+    bool m_trafficWheel;
+    double m_trafficStart;
+    double m_simTime;
+    bool m_flowmon;
+    double m_flowmonSample;
+    std::string m_flowmonFile;
+    bool m_printResults;
+    bool m_flowsOnly;          //stop once the flows are drawn
+    uint64_t m_offeredBytesPerSource;
+    double m_networkCap;
+    bool m_setupProfile;
+    bool m_runRecord;
+    std::string m_eventProfile; //folded-stack file, empty = no callback profile
+    uint64_t m_channelWidth; //Hz, 0 = the standard's default until the PHYs exist
+    double m_throughputInterval;
+    std::string m_throughputFile;
+    uint64_t m_lastRecvBytes;  //at the previous throughput sample
+    Time m_trafficEnd;         //last source close, after which nothing new is sent
+    std::string m_mobility;    //static, waypoint or walk
+    double m_minSpeed;
+    double m_maxSpeed;
+    double m_pause;
+    uint32_t m_sinkDraw;       //0 = default flow draw, else an alternative set of sinks
+    std::vector<double> m_warmIntensities;
+    std::vector<double> m_warmSinkDraws;
+    bool m_warmStarted;        //throughput sampling and overhead counting already set up
+    bool m_warmChild;          //this process is one forked variant
+    bool m_memoryReport;
+    double m_memoryInterval;
+    uint32_t m_simulatedNodes;
     
+    friend class SetupBench;
 };
 
 AdHocExperiment::AdHocExperiment ()
@@ -87,7 +1369,6 @@ AdHocExperiment::AdHocExperiment ()
 }
 
 AdHocExperiment::AdHocExperiment (double nodeDensity, double txp, uint32_t protocol, double intensity, double onTime, double offTime) :
-m_output("P3Experiment"),
 m_totalTime (33),
 m_intensity(intensity),
 m_onTime(onTime),
@@ -100,12 +1381,331 @@ m_gridSize (1000), //1000x1000 grid  for a total of 1000000 nodes
 m_nodeDistance (30),
 m_port (5000),
 m_nodeDensity(nodeDensity),
-m_protocol(protocol)
+m_protocol(protocol),
+m_trafficWheel(true),
+m_trafficStart(protocol == 2 ? 0.0 : 1.0), //oracle routes need no convergence time
+m_simTime(10.0),
+m_flowmon(false),
+m_flowmonSample(1.0),
+m_printResults(true),
+m_flowsOnly(false),
+m_offeredBytesPerSource(0),
+m_networkCap(0),
+m_setupProfile(false),
+m_runRecord(false),
+m_channelWidth(0),
+m_throughputInterval(0.1),
+m_lastRecvBytes(0),
+m_mobility("static"),
+m_minSpeed(0.5),
+m_maxSpeed(5.0),
+m_pause(1.0),
+m_sinkDraw(0),
+m_warmStarted(false),
+m_warmChild(false),
+m_memoryReport(false),
+m_memoryInterval(1.0),
+m_simulatedNodes(0)
+{
+}
+
+
+//Print wall time and resident size (and allocations with the operator new hooks) of each setup phase after the run
+void AdHocExperiment::EnableSetupProfile ()
+{
+    m_setupProfile = true;
+}
+
+//Print one runProfile record (phase wall times, event rate) after the run;
+//EnableEventCounting () must have been called before the simulator started
+void AdHocExperiment::EnableRunRecord ()
+{
+    m_runRecord = true;
+}
+
+//Print the callback profile after the run and write its folded stacks;
+//EnableEventProfile () (the free function) must have set up the simulator
+void AdHocExperiment::EnableEventProfile (std::string foldedFile)
+{
+    m_eventProfile = foldedFile;
+}
+
+//Channel width for the PHYs and the capacity estimate (20, 40, 80 or 160 MHz),
+//0 = whatever the standard sets
+void AdHocExperiment::SetChannelWidth (uint32_t widthMhz)
+{
+    m_channelWidth = (uint64_t) widthMhz * 1000000;
+}
+
+//Throughput sampling period, and optionally a file every sample is streamed to
+void AdHocExperiment::SetThroughputSampling (double interval, std::string fileName)
+{
+    m_throughputInterval = interval;
+    m_throughputFile = fileName;
+}
+
+//Move nodes by random waypoint or random walk within the occupied part of the grid
+void AdHocExperiment::SetMobility (std::string model, double minSpeed, double maxSpeed, double pause)
+{
+    NS_ABORT_MSG_UNLESS (model == "static" || model == "waypoint" || model == "walk",
+                         "Invalid mobility: use static, waypoint or walk");
+    m_mobility = model;
+    m_minSpeed = minSpeed;
+    m_maxSpeed = maxSpeed;
+    m_pause = pause;
+}
+
+//Draw the flows from another fixed stream: the same sources with other sinks
+void AdHocExperiment::SetSinkDraw (uint32_t draw)
+{
+    m_sinkDraw = draw;
+}
+
+//Converge routing once, then fork one child per (intensity, sink draw) variant
+void AdHocExperiment::EnableWarmStart (const std::vector<double> &intensities, const std::vector<double> &sinkDraws)
+{
+    m_warmIntensities = intensities;
+    m_warmSinkDraws = sinkDraws;
+    if (m_warmIntensities.empty ())
+        m_warmIntensities.push_back (m_intensity);
+    if (m_warmSinkDraws.empty ())
+        m_warmSinkDraws.push_back (m_sinkDraw);
+}
+
+/**
+ * Run the traffic-free routing warm-up once, up to the traffic start, then
+ * fork a copy-on-write child per variant. Returns true in a child, which
+ * applies its variant and finishes the run; the parent waits for all of
+ * them, reports the time saved against cold starts and returns false.
+ * Events tied at the checkpoint instant may run in a different order than
+ * in a cold run, since the traffic is scheduled after the warm-up.
+ */
+bool AdHocExperiment::WarmStart (double setupStart)
+{
+    NS_ABORT_MSG_IF (m_protocol == 2, "Oracle routes have no warm-up to share");
+    // Started before the checkpoint so samples and counts match a cold run
+    Simulator::Schedule (Seconds (m_throughputInterval), &AdHocExperiment::CheckThroughput, this);
+    m_overhead.Install ();
+    m_warmStarted = true;
+
+    double warmStart = WallSeconds ();
+    double setupWall = warmStart - setupStart;
+    ScenarioStop (Seconds (m_trafficStart));
+    Simulator::Run ();
+    double warmWall = WallSeconds () - warmStart;
+
+    std::vector<std::pair<double, double> > variants;
+    for (uint32_t i = 0; i < m_warmIntensities.size (); i++)
+        for (uint32_t d = 0; d < m_warmSinkDraws.size (); d++)
+            variants.push_back (std::make_pair (m_warmIntensities[i], m_warmSinkDraws[d]));
+
+    long cores = sysconf (_SC_NPROCESSORS_ONLN);
+    uint32_t maxChildren = cores > 0 ? cores : 1;
+    uint32_t running = 0, failed = 0;
+    double forkStart = WallSeconds ();
+    std::cout.flush ();
+    std::cerr.flush ();
+    for (uint32_t v = 0; v <= variants.size (); v++)
+    {
+        // Keep at most one child per core
+        while (running > 0 && (running >= maxChildren || v == variants.size ())) {
+            int status;
+            if (wait (&status) < 0)
+                break;
+            running--;
+            if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+                failed++;
+        }
+        if (v == variants.size ())
+            break;
+        pid_t pid = fork ();
+        if (pid == 0) {
+            m_warmChild = true;
+            m_intensity = variants[v].first;
+            m_sinkDraw = (uint32_t) variants[v].second;
+            if (!m_throughputFile.empty ()) {
+                std::ostringstream name;
+                name << m_throughputFile << ".variant" << v;
+                m_throughputFile = name.str ();
+            }
+            if (!m_eventProfile.empty ()) {
+                std::ostringstream name;
+                name << m_eventProfile << ".variant" << v;
+                m_eventProfile = name.str ();
+            }
+            return true;
+        }
+        if (pid < 0)
+            failed++;
+        else
+            running++;
+    }
+    double variantsWall = WallSeconds () - forkStart;
+
+    // Every cold run would repeat the setup and the warm-up
+    std::cerr << "warmStart,p3";
+    std::cerr << ",variants,"  << variants.size ();
+    std::cerr << ",failed,"    << failed;
+    std::cerr << ",setup(s),"  << setupWall;
+    std::cerr << ",warmup(s)," << warmWall;
+    std::cerr << ",variants(s)," << variantsWall;
+    std::cerr << ",savedVsCold(s)," << (variants.size () - 1) * (setupWall + warmWall);
+    std::cerr << std::endl;
+    Simulator::Destroy ();
+    return false;
+}
+
+//Sample resident size (and live heap with the operator new hooks) during the run and print memory growth per node by module
+void AdHocExperiment::EnableMemoryReport (double interval)
+{
+    m_memoryReport = true;
+    m_memoryInterval = interval;
+}
+
+const std::vector<SetupProfile::Phase> &AdHocExperiment::GetSetupPhases () const
+{
+    return m_profile.GetPhases ();
+}
+
+uint32_t AdHocExperiment::GetSimulatedNodes () const
+{
+    return m_simulatedNodes;
+}
+
+//Set up up to the flow draw and return without simulating or printing
+void AdHocExperiment::SetFlowsOnly ()
+{
+    m_flowsOnly = true;
+    m_printResults = false;
+}
+
+//The (source, destination) node indices of the last draw
+const std::vector<std::pair<uint32_t, uint32_t> > &AdHocExperiment::GetFlows () const
+{
+    return m_flows;
+}
+
+//Simulate only one component; results are merged by the caller, not printed
+void AdHocExperiment::SetComponent (const ComponentPlan &plan)
+{
+    m_nodeIndices = plan.nodes;
+    m_flows = plan.flows;
+    m_printResults = false;
+}
+
+uint64_t AdHocExperiment::GetRecvBytes () const
+{
+    return m_RecvBytesTotal;
+}
+
+uint64_t AdHocExperiment::GetSentBytes () const
+{
+    return m_SentBytesTotal;
+}
+
+uint64_t AdHocExperiment::GetOfferedBytesPerSource () const
+{
+    return m_offeredBytesPerSource;
+}
+
+double AdHocExperiment::GetNetworkCapacity () const
 {
-    m_output.SetStyle (Gnuplot2dDataset::LINES);
+    return m_networkCap;
+}
+
+//Nodes on the whole map
+uint32_t AdHocExperiment::GetNumNodes () const
+{
+    uint32_t mapSize = m_gridSize * m_gridSize;
+    return (uint32_t)(m_nodeDensity * (double)mapSize);
+}
+
+//Where GridPositionAllocator (RowFirst) puts node index
+Vector AdHocExperiment::GetGridPosition (uint32_t index) const
+{
+    return Vector ((double) m_nodeDistance * (index % m_gridSize),
+                   (double) m_nodeDistance * (index / m_gridSize), 0.0);
+}
+
+/**
+ * Split the map into radio-connected components. Flows are drawn here for
+ * the whole map, exactly as SelectSrcDest would draw them, and each one is
+ * handed to the component holding both of its ends. Flows whose destination
+ * lies in another component are counted and returned as unreachable. The
+ * whole draw is kept for GetFlows.
+ */
+uint32_t AdHocExperiment::PlanComponents (double rangeM, std::vector<ComponentPlan> &plans)
+{
+    uint32_t numOfNodes = GetNumNodes ();
+    std::vector<double> x (numOfNodes), y (numOfNodes);
+    for (uint32_t i = 0; i < numOfNodes; i++)
+    {
+        Vector pos = GetGridPosition (i);
+        x[i] = pos.x;
+        y[i] = pos.y;
+    }
+    std::vector<std::vector<uint32_t> > neighbours;
+    BuildNeighbours (x, y, rangeM, neighbours);
+
+    // Label components by breadth-first search
+    std::vector<int64_t> component (numOfNodes, -1);
+    std::vector<uint32_t> local (numOfNodes);
+    plans.clear ();
+    for (uint32_t i = 0; i < numOfNodes; i++)
+    {
+        if (component[i] >= 0)
+            continue;
+        plans.push_back (ComponentPlan ());
+        ComponentPlan &plan = plans.back ();
+        component[i] = plans.size () - 1;
+        plan.nodes.push_back (i);
+        for (uint32_t head = 0; head < plan.nodes.size (); head++)
+        {
+            uint32_t u = plan.nodes[head];
+            for (uint32_t k = 0; k < neighbours[u].size (); k++)
+            {
+                uint32_t v = neighbours[u][k];
+                if (component[v] < 0)
+                {
+                    component[v] = component[i];
+                    plan.nodes.push_back (v);
+                }
+            }
+        }
+        std::sort (plan.nodes.begin (), plan.nodes.end ());
+        for (uint32_t k = 0; k < plan.nodes.size (); k++)
+            local[plan.nodes[k]] = k;
+    }
+
+    uint32_t unreachable = 0;
+    m_flows = DrawFlows (numOfNodes);
+    for (uint32_t f = 0; f < m_flows.size (); f++)
+    {
+        uint32_t src = m_flows[f].first;
+        uint32_t dst = m_flows[f].second;
+        if (component[src] != component[dst])
+        {
+            unreachable++;
+            continue;
+        }
+        plans[component[src]].flows.push_back (std::make_pair (local[src], local[dst]));
+    }
+    return unreachable;
+}
 
+//Drive sources from one PeriodicTrafficWheel (default) or one GenerateTraffic chain each
+void AdHocExperiment::SetTrafficWheel (bool enable)
+{
+    m_trafficWheel = enable;
 }
 
+//Per-flow statistics for a sampled fraction of the flows, written to fileName after the run
+void AdHocExperiment::EnableFlowMonitor (double sampleFraction, std::string fileName)
+{
+    m_flowmon = true;
+    m_flowmonSample = sampleFraction;
+    m_flowmonFile = fileName;
+}
 
 //Used to make sure we get the accurate bytesTotal at the end
 void AdHocExperiment::ReceivePacket (Ptr<Socket> socket)
@@ -114,6 +1714,9 @@ void AdHocExperiment::ReceivePacket (Ptr<Socket> socket)
     while ((packet = socket->Recv ()))
     {
         m_RecvBytesTotal += packet->GetSize ();
+        //Per packet: build with -DSCENARIO_LOG_LEVEL=4 and thin out with SCENARIO_LOG_EVERY/RATE
+        SCENARIO_LOG_DEBUG ("rx,time(s)," << Simulator::Now ().GetSeconds () << ",node," << socket->GetNode ()->GetId ()
+                            << ",bytes," << packet->GetSize ());
     }
 }
 
@@ -127,12 +1730,47 @@ void AdHocExperiment::SendPacket (Ptr<Socket> socket, uint32_t dataSent)
 //Used to check throughput
 void AdHocExperiment::CheckThroughput ()
 {
-    double mbs = ((m_RecvBytesTotal * 8.0) /1000000);
-    //m_RecvBytesTotal = 0;
-    m_output.Add ((Simulator::Now ()).GetSeconds (), mbs);
+    uint64_t bytes = m_RecvBytesTotal - m_lastRecvBytes;
+    m_lastRecvBytes = m_RecvBytesTotal;
+    double mbs = (bytes * 8.0) / 1000000 / m_throughputInterval;
+    m_throughput.Add ((Simulator::Now ()).GetSeconds (), mbs);
+    
+    //Once every source has closed, stop at the first interval with nothing delivered
+    if (!m_trafficEnd.IsZero () && Simulator::Now () >= m_trafficEnd && bytes == 0)
+        return;
+    Simulator::Schedule (Seconds (m_throughputInterval), &AdHocExperiment::CheckThroughput, this);
+}
+
+//Memory while the routing tables fill up; OLSR tables are also counted in routes
+void AdHocExperiment::SampleMemory (NodeContainer c)
+{
+    uint64_t olsrRoutes = 0;
+    if (m_protocol == 0) {
+        for (uint32_t i = 0; i < c.GetN (); i++) {
+            Ptr<olsr::RoutingProtocol> olsr = c.Get (i)->GetObject<olsr::RoutingProtocol> ();
+            if (olsr)
+                olsrRoutes += olsr->GetRoutingTableEntries ().size ();
+        }
+    }
+    std::cerr << "memory,p3";
+    std::cerr << ",nodes,"    << c.GetN ();
+    std::cerr << ",time(s),"  << Simulator::Now ().GetSeconds ();
+    std::cerr << ",rss,"      << ResidentBytes ();
+    if (g_allocationHooks) {
+        std::cerr << ",heapLive," << g_allocationCounters.liveBytes;
+        std::cerr << ",heapLivePerNode," << (double) g_allocationCounters.liveBytes / c.GetN ();
+    }
+    if (m_protocol == 0)
+        std::cerr << ",olsrRoutes," << olsrRoutes;
+    std::cerr << std::endl;
     
-    //check throughput every 1/10 of a second
-    Simulator::Schedule (Seconds (0.1), &AdHocExperiment::CheckThroughput, this);
+    Simulator::Schedule (Seconds (m_memoryInterval), &AdHocExperiment::SampleMemory, this, c);
+}
+
+//Average received throughput over the traffic period
+double AdHocExperiment::GetThroughputMbs () const
+{
+    return (m_RecvBytesTotal * 8.0) / 1000000 / (m_simTime - m_trafficStart);
 }
 
 //Used to check efficiency
@@ -151,10 +1789,25 @@ double AdHocExperiment::CheckEfficiency ()
  * may be the source for multiple destinations and a node maybe a destination
  * for multiple sources.
  */
-void AdHocExperiment::SelectSrcDest (NodeContainer c, uint64_t dataRate)
+void AdHocExperiment::SelectSrcDest (const NodeContainer &c, uint64_t dataRate)
+{
+    // A component run comes with its flows already chosen
+    if (m_flows.empty ())
+        m_flows = DrawFlows (c.GetN ());
+    for (uint32_t f = 0; f < m_flows.size (); f++)
+    {
+        uint32_t dst = m_flows[f].second;
+        ApplicationSetup (c.Get (m_flows[f].first), c.Get (dst), m_interfaces.GetAddress (dst),
+                          0, m_totalTime, dataRate);
+    }
+}
+
+std::vector<std::pair<uint32_t, uint32_t> > AdHocExperiment::DrawFlows (uint32_t totalNodes) const
 {
-    uint32_t totalNodes = c.GetN ();
+    std::vector<std::pair<uint32_t, uint32_t> > flows;
+    flows.reserve (totalNodes);
     Ptr<UniformRandomVariable> uvDest = CreateObject<UniformRandomVariable> ();
+    uvDest->SetStream (SINK_DRAW_STREAM_BASE + m_sinkDraw);
     uvDest->SetAttribute ("Min", DoubleValue (0));
     uvDest->SetAttribute ("Max", DoubleValue (totalNodes - 1));
     
@@ -168,20 +1821,164 @@ void AdHocExperiment::SelectSrcDest (NodeContainer c, uint64_t dataRate)
         }
         //std::cout << "A: " << a;
         //std::cout << " B, " <<b << std::endl;
-        ApplicationSetup (c.Get (a), c.Get (b),  0, m_totalTime, dataRate);
+        flows.push_back (std::make_pair ((uint32_t) a, (uint32_t) b));
     }
+    return flows;
 }
 
-void AdHocExperiment::ApplicationSetup (Ptr<Node> client, Ptr<Node> server, double start, double stop, uint64_t dataRate)
+/**
+ * Oracle routing (protocol 2): hop-count shortest paths over the static
+ * connectivity graph, computed once and installed as host routes in
+ * Ipv4StaticRouting. One breadth-first search per destination gives the
+ * next hop of every node; routes are installed only along the paths the
+ * flows actually use, so no routing control traffic is ever sent.
+ */
+void AdHocExperiment::PopulateOracleRoutes (NodeContainer c, const Ipv4InterfaceContainer &interfaces, double rangeM)
 {
-    Ptr<Ipv4> ipv4Server = server->GetObject<Ipv4> ();
-    
-    Ipv4InterfaceAddress iaddrServer = ipv4Server->GetAddress (1,0);
-    Ipv4Address ipv4AddrServer = iaddrServer.GetLocal ();
+    std::vector<double> x (c.GetN ()), y (c.GetN ());
+    for (uint32_t i = 0; i < c.GetN (); i++)
+    {
+        Vector pos = c.Get (i)->GetObject<MobilityModel> ()->GetPosition ();
+        x[i] = pos.x;
+        y[i] = pos.y;
+    }
+    std::vector<std::vector<uint32_t> > neighbours;
+    BuildNeighbours (x, y, rangeM, neighbours);
+
+    std::map<uint32_t, std::vector<uint32_t> > sourcesByDest;
+    for (uint32_t f = 0; f < m_flows.size (); f++)
+        sourcesByDest[m_flows[f].second].push_back (m_flows[f].first);
+
+    Ipv4StaticRoutingHelper staticRouting;
+    std::vector<int64_t> parent (c.GetN ());
+    std::vector<bool> routed (c.GetN ());
+    std::vector<uint32_t> queue;
+    queue.reserve (c.GetN ());
+    for (std::map<uint32_t, std::vector<uint32_t> >::const_iterator it = sourcesByDest.begin ();
+         it != sourcesByDest.end (); ++it)
+    {
+        uint32_t dest = it->first;
+        std::fill (parent.begin (), parent.end (), -1);
+        std::fill (routed.begin (), routed.end (), false);
+        parent[dest] = dest;
+        queue.clear ();
+        queue.push_back (dest);
+        for (uint32_t head = 0; head < queue.size (); head++)
+        {
+            uint32_t u = queue[head];
+            for (uint32_t k = 0; k < neighbours[u].size (); k++)
+            {
+                uint32_t v = neighbours[u][k];
+                if (parent[v] < 0)
+                {
+                    parent[v] = u;
+                    queue.push_back (v);
+                }
+            }
+        }
+
+        // Walk each source towards the destination until an already routed node
+        Ipv4Address destAddr = interfaces.GetAddress (dest);
+        for (uint32_t k = 0; k < it->second.size (); k++)
+        {
+            uint32_t u = it->second[k];
+            if (parent[u] < 0)
+                continue; // unreachable: packets are dropped at the source
+            while (u != dest && !routed[u])
+            {
+                uint32_t next = parent[u];
+                Ptr<Ipv4StaticRouting> routing = staticRouting.GetStaticRouting (c.Get (u)->GetObject<Ipv4> ());
+                routing->AddHostRouteTo (destAddr, interfaces.GetAddress (next), 1);
+                routed[u] = true;
+                u = next;
+            }
+        }
+    }
+}
+
+/**
+ * Flows are sampled with a fixed stride rather than a random draw so that
+ * enabling sampling does not shift the random streams of the experiment.
+ */
+bool AdHocExperiment::IsFlowSampled (uint32_t flow) const
+{
+    if (m_flowmonSample >= 1.0)
+        return true;
+    if (m_flowmonSample <= 0.0)
+        return false;
+    uint32_t stride = (uint32_t) std::floor (1.0 / m_flowmonSample + 0.5);
+    return (flow % stride) == 0;
+}
+
+//Probes go on the endpoints of sampled flows only; relays are not instrumented
+Ptr<FlowMonitor> AdHocExperiment::InstallFlowMonitor (FlowMonitorHelper &helper, NodeContainer c)
+{
+    if (m_flowmonSample >= 1.0)
+        return helper.InstallAll ();
+
+    std::vector<bool> probed (c.GetN (), false);
+    NodeContainer endpoints;
+    for (uint32_t f = 0; f < m_flows.size (); f++)
+    {
+        if (!IsFlowSampled (f))
+            continue;
+        uint32_t ends[2] = { m_flows[f].first, m_flows[f].second };
+        for (uint32_t k = 0; k < 2; k++)
+        {
+            if (!probed[ends[k]])
+            {
+                probed[ends[k]] = true;
+                endpoints.Add (c.Get (ends[k]));
+            }
+        }
+    }
+    return helper.Install (endpoints);
+}
+
+//One line per sampled flow, written as the stats are walked
+void AdHocExperiment::WriteFlowStats (Ptr<FlowMonitor> flowmon, FlowMonitorHelper &helper, NodeContainer c)
+{
+    flowmon->CheckForLostPackets ();
+    Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (helper.GetClassifier ());
+
+    // Sampled (source, destination) address pairs
+    std::set<std::pair<Ipv4Address, Ipv4Address> > sampled;
+    for (uint32_t f = 0; f < m_flows.size (); f++)
+    {
+        if (!IsFlowSampled (f))
+            continue;
+        Ipv4Address src = c.Get (m_flows[f].first)->GetObject<Ipv4> ()->GetAddress (1, 0).GetLocal ();
+        Ipv4Address dst = c.Get (m_flows[f].second)->GetObject<Ipv4> ()->GetAddress (1, 0).GetLocal ();
+        sampled.insert (std::make_pair (src, dst));
+    }
+
+    std::ofstream out (m_flowmonFile.c_str ());
+    out << "#src dst txPackets rxPackets lostPackets throughput(Mbs) meanDelay(ms) loss" << std::endl;
+    const FlowMonitor::FlowStatsContainer &stats = flowmon->GetFlowStats ();
+    for (FlowMonitor::FlowStatsContainer::const_iterator it = stats.begin (); it != stats.end (); ++it)
+    {
+        Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (it->first);
+        if (t.destinationPort != m_port || !sampled.count (std::make_pair (t.sourceAddress, t.destinationAddress)))
+            continue;
+        const FlowMonitor::FlowStats &fs = it->second;
+        double active = (fs.timeLastRxPacket - fs.timeFirstTxPacket).GetSeconds ();
+        double throughput = (fs.rxPackets > 0 && active > 0) ? fs.rxBytes * 8.0 / active / 1000000 : 0;
+        double delay = (fs.rxPackets > 0) ? fs.delaySum.GetSeconds () * 1000 / fs.rxPackets : 0;
+        double loss = (fs.txPackets > 0) ? (double) fs.lostPackets / fs.txPackets : 0;
+        out << t.sourceAddress << " " << t.destinationAddress
+            << " " << fs.txPackets << " " << fs.rxPackets << " " << fs.lostPackets
+            << " " << throughput << " " << delay << " " << loss << "\n";
+    }
+}
+
+void AdHocExperiment::ApplicationSetup (Ptr<Node> client, Ptr<Node> server, Ipv4Address serverAddress,
+                                        double start, double stop, uint64_t dataRate)
+{
+    Ipv4Address ipv4AddrServer = serverAddress;
     
     // Setting up sink and source
     //Sink
-    TypeId tid = TypeId::LookupByName ("ns3::UdpSocketFactory");
+    static const TypeId tid = UdpSocketFactory::GetTypeId (); //no per-node name lookup
     Ptr<Socket> recvSink = Socket::CreateSocket (server, tid);
     InetSocketAddress local = InetSocketAddress (ipv4AddrServer, m_port);
     recvSink->Bind (local);
@@ -199,38 +1996,58 @@ void AdHocExperiment::ApplicationSetup (Ptr<Node> client, Ptr<Node> server, doub
     uint32_t numPackets = dataRate /(double) m_packetSize ;  //Number of packets based on intensity and networkCapacity
     double interPacketInterval = (double) 9/numPackets; //Periodic interval to send packets
     Time interPacketInterval2(interPacketInterval);
+    //Both traffic drivers close the socket one interval after the last send
+    Time end = Seconds (m_trafficStart) + NanoSeconds (interPacketInterval2.GetNanoSeconds () * (numPackets + 1));
+    if (end > m_trafficEnd)
+        m_trafficEnd = end;
     // std::cout<<"packet count="<<numPackets<<"time="<<interPacketInterval<<"\n";
     //std::cout<< numPackets << std::endl;
     
     
     // Give time to converge-- 30 seconds perhaps
-    Simulator::Schedule (Seconds (1.0), &GenerateTraffic,
-                         source, m_packetSize, numPackets, interPacketInterval2);
+    if (m_trafficWheel)
+        m_traffic.AddSource (source, m_packetSize, numPackets, Seconds (m_trafficStart) - Simulator::Now (),
+                             interPacketInterval2);
+    else
+        Simulator::Schedule (Seconds (m_trafficStart) - Simulator::Now (), &GenerateTraffic,
+                             source, m_packetSize, numPackets, interPacketInterval2);
     
     
     
     
 }
 
-Gnuplot2dDataset AdHocExperiment::Run (const WifiHelper &wifi, const YansWifiPhyHelper &wifiPhy,
-                 const NqosWifiMacHelper &wifiMac, const YansWifiChannelHelper &wifiChannel, const MobilityHelper &mobility)
+void AdHocExperiment::Run (const WifiHelper &wifi, const YansWifiPhyHelper &wifiPhy,
+                 const WifiMacHelper &wifiMac, const YansWifiChannelHelper &wifiChannel, const MobilityHelper &mobility)
 {
     
     
-    uint32_t mapSize = m_gridSize * m_gridSize;            //Total map size
-    uint32_t numOfNodes = (uint32_t)(m_nodeDensity * (double)mapSize);   //Number of total nodes on the map
+    //Phases run from construction: the caller's helper setup is "configuration"
+    m_profile.Mark ("configuration");
+    double setupStart = WallSeconds ();
+    uint32_t numOfNodes = GetNumNodes ();   //Number of total nodes on the map
     NodeContainer c;
-    c.Create (numOfNodes);      //Create the nodes
+    c.Create (m_nodeIndices.empty () ? numOfNodes : m_nodeIndices.size ());      //Create the nodes
+    m_simulatedNodes = c.GetN ();
+    m_profile.Mark ("nodes");
     
     YansWifiPhyHelper phy = wifiPhy;
     phy.SetChannel (wifiChannel.Create ());
     
-    NqosWifiMacHelper mac = wifiMac;
-    mac.SetType ("ns3::AdhocWifiMac");
+    const WifiMacHelper &mac = wifiMac; //already set up as ns3::AdhocWifiMac by the caller
     
     phy.Set ("TxPowerStart",DoubleValue (m_txp));   //Set transmission power
     phy.Set ("TxPowerEnd", DoubleValue (m_txp));    //Set transmission power
     NetDeviceContainer devices = wifi.Install (phy, mac, c);
+    // Installing the standard sets its default width, so override afterwards;
+    // capacity and noise below use whatever width the PHYs ended up with
+    if (m_channelWidth == 0)
+        m_channelWidth = (uint64_t) DynamicCast<YansWifiPhy> (DynamicCast<WifiNetDevice> (devices.Get (0))->GetPhy ())
+                         ->GetChannelWidth () * 1000000;
+    for (uint32_t i = 0; i < devices.GetN (); i++)
+        DynamicCast<YansWifiPhy> (DynamicCast<WifiNetDevice> (devices.Get (i))->GetPhy ())
+            ->SetChannelWidth (m_channelWidth / 1000000);
+    m_profile.Mark ("wifi");
     
 
     AodvHelper aodv;
@@ -244,75 +2061,804 @@ Gnuplot2dDataset AdHocExperiment::Run (const WifiHelper &wifi, const YansWifiPhy
     InternetStackHelper internet;
     if (m_protocol == 1)
         list.Add (aodv, 10);
-    else
+    else if (m_protocol == 0)
         list.Add (olsr, 10);
     
     internet.SetRoutingHelper (list); // has effect on the next Install ()
     internet.Install (c);
+    m_profile.Mark ("internet");
     
     
     Ipv4AddressHelper address;
     address.SetBase ("10.0.0.0", "255.255.0.0");
     
-    Ipv4InterfaceContainer ipInterfaces;
+    Ipv4InterfaceContainer &ipInterfaces = m_interfaces;
     ipInterfaces = address.Assign (devices);
+    m_profile.Mark ("addresses");
     
-    MobilityHelper mobil= mobility;
-
-    
-    
-    mobil.SetPositionAllocator ("ns3::GridPositionAllocator",
-                                "MinX", DoubleValue (0.0),
-                                "MinY", DoubleValue (0.0),
-                                "DeltaX", DoubleValue (m_nodeDistance),
-                                "DeltaY", DoubleValue (m_nodeDistance),
-                                "GridWidth", UintegerValue (m_gridSize),
-                                "LayoutType", StringValue ("RowFirst"));
-    
-    
-    mobil.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
-    mobil.Install (c);
+    // Grid positions set directly on each model: same layout as
+    // GridPositionAllocator (RowFirst) without per-node attribute handling.
+    // A component run keeps the spots its nodes hold on the full map.
+    if (m_mobility == "static") {
+        for (uint32_t i = 0; i < c.GetN (); i++)
+        {
+            Ptr<ConstantPositionMobilityModel> model = CreateObject<ConstantPositionMobilityModel> ();
+            model->SetPosition (GetGridPosition (m_nodeIndices.empty () ? i : m_nodeIndices[i]));
+            c.Get (i)->AggregateObject (model);
+        }
+    } else {
+        // Positions, oracle routes and components all assume a fixed layout
+        NS_ABORT_MSG_IF (m_protocol == 2 || !m_nodeIndices.empty (),
+                         "Mobility needs protocol 0 or 1 without --components");
+        // Start on the grid and roam the rows it occupies (at least one node spacing deep)
+        Vector last = GetGridPosition (c.GetN () - 1);
+        double xMax = c.GetN () > m_gridSize ? (m_gridSize - 1) * m_nodeDistance : last.x;
+        Rectangle bounds (0.0, std::max (xMax, (double) m_nodeDistance), 0.0, std::max (last.y, (double) m_nodeDistance));
+        int64_t stream = 0;
+        for (uint32_t i = 0; i < c.GetN (); i++)
+        {
+            Ptr<LazyWaypointMobilityModel> model = CreateObject<LazyWaypointMobilityModel> ();
+            model->SetAttribute ("Walk", BooleanValue (m_mobility == "walk"));
+            model->SetAttribute ("MinSpeed", DoubleValue (m_minSpeed));
+            model->SetAttribute ("MaxSpeed", DoubleValue (m_maxSpeed));
+            model->SetAttribute ("Pause", DoubleValue (m_pause));
+            model->SetAttribute ("Bounds", RectangleValue (bounds));
+            model->SetPosition (GetGridPosition (i));
+            stream += model->AssignStreams (stream);
+            c.Get (i)->AggregateObject (model);
+        }
+    }
+    m_profile.Mark ("mobility");
     
     // Determine the data rate to be used based on the intensity and network capacity.
     Ptr<WifiNetDevice> wifiDevice = DynamicCast<WifiNetDevice> (devices.Get(0));
-    uint64_t networkCap = IEEE_80211_BANDWIDTH *
+    uint64_t networkCap = m_channelWidth *
                           log (1 + wifiDevice->GetPhy()->CalculateSnr (wifiDevice->GetPhy()->GetMode(0), 0.1)) / log (2);
     
+    if (!m_warmIntensities.empty () && !WarmStart (setupStart))
+        return;
      
     uint64_t dataRate  = (uint64_t)(networkCap * m_intensity) / (double)(numOfNodes);
+    m_networkCap = networkCap;
+    m_offeredBytesPerSource = (uint64_t)(dataRate / (double) m_packetSize) * m_packetSize;
 
 
     
     SelectSrcDest (c, dataRate);  //Setup applications
-    CheckThroughput ();
+    m_profile.Mark ("applications");
+    if (m_flowsOnly) {
+        Simulator::Destroy ();
+        return;
+    }
+    if (!m_throughputFile.empty ())
+        m_throughput.Open (m_throughputFile);
+    if (!m_warmStarted) {
+        //First sample one interval in, so every sample covers a full interval
+        Simulator::Schedule (Seconds (m_throughputInterval), &AdHocExperiment::CheckThroughput, this);
+        m_overhead.Install ();
+    }
+
+    if (m_protocol == 2) {
+        // A link exists where the received power reaches the energy detection threshold
+        Ptr<YansWifiPhy> yansPhy = DynamicCast<YansWifiPhy> (wifiDevice->GetPhy ());
+        double range = RadioRange (m_txp + yansPhy->GetTxGain () + yansPhy->GetRxGain (),
+                                   yansPhy->GetEdThreshold (), DefaultLogDistanceParams ());
+        PopulateOracleRoutes (c, ipInterfaces, range);
+        m_profile.Mark ("routing");
+    }
 
     
     Ptr<FlowMonitor> flowmon;
     FlowMonitorHelper flowmonHelper;
     
-
-    flowmon = flowmonHelper.InstallAll ();
+    if (m_flowmon)
+        flowmon = InstallFlowMonitor (flowmonHelper, c);
+    if (m_memoryReport)
+        SampleMemory (c);
+    m_profile.Mark ("instrumentation");
 
     
-    Simulator::Stop (Seconds (10.0));
+    ScenarioStop (Seconds (m_simTime) - Simulator::Now ());
+    EventCounts events = GetEventCounts ();
+    double runStart = WallSeconds ();
     Simulator::Run ();
+    double runWall = WallSeconds () - runStart;
+    m_profile.Mark ("run");
+    //Only this run's events; a warm-started variant shares the warm-up's
+    EventCounts after = GetEventCounts ();
+    events.executed = after.executed - events.executed;
+    events.scheduled = after.scheduled - events.scheduled;
+    events.peakPending = after.peakPending;
+    if (!m_eventProfile.empty ())
+        PrintEventProfile (std::cerr, "p3", m_eventProfile);
     
-    /*if (enableFlowMon)
-    {
-        flowmon->SerializeToXmlFile ((GetOutputFileName () + ".flomon"), false, false);
-    }*/
+    if (m_flowmon)
+        WriteFlowStats (flowmon, flowmonHelper, c);
     
-    std::cout << "nodeDensity,"   << m_nodeDensity;
-    std::cout << ",protocol,"     << m_protocol;
-    std::cout << ",txp(dBm/n),"   << m_txp;
-    std::cout << ",intensity,"    << m_intensity;
-    std::cout << ",Efficiency, "  << CheckEfficiency(); //Print out efficiency
-    std::cout << ",totalRxBytes," << m_RecvBytesTotal;
-    std::cout << ",totalTxBytes," << m_SentBytesTotal;
-    std::cout << ",Network Capacity(Mbs)," << networkCap/1000000 << std::endl;
+    if (m_printResults) {
+        std::cout << "nodeDensity,"   << m_nodeDensity;
+        std::cout << ",protocol,"     << m_protocol;
+        std::cout << ",txp(dBm/n),"   << m_txp;
+        std::cout << ",intensity,"    << m_intensity;
+        if (m_sinkDraw > 0)
+            std::cout << ",sinkDraw," << m_sinkDraw;
+        std::cout << ",Efficiency, "  << CheckEfficiency(); //Print out efficiency
+        std::cout << ",totalRxBytes," << m_RecvBytesTotal;
+        std::cout << ",totalTxBytes," << m_SentBytesTotal;
+        std::cout << ",Network Capacity(Mbs)," << networkCap/1000000;
+        m_throughput.Print (std::cout);
+        m_overhead.Print (std::cout);
+        if (m_trafficWheel) {
+            std::cout << ",trafficEvents,"       << m_traffic.GetEventCount ();
+            std::cout << ",legacyTrafficEvents," << m_traffic.GetLegacyEventCount ();
+        }
+        // Compare runWall with and without --flowmon for the monitoring overhead
+        std::cout << ",flowmon,"      << (m_flowmon ? m_flowmonSample : 0.0);
+        std::cout << ",runWall(s),"   << runWall;
+        std::cout << std::endl;
+    }
     Simulator::Destroy ();
+    m_profile.Mark ("destroy");
+    if (m_setupProfile)
+        m_profile.Print (std::cerr, "p3", c.GetN ());
+    if (m_runRecord)
+        PrintRunRecord (std::cerr, "p3", c.GetN (), m_profile, events, runWall);
+    if (m_memoryReport) {
+        // Setup phases map onto the modules they install; "run" is state
+        // built up while simulating (routing tables, queues, pending events)
+        const std::vector<SetupProfile::Phase> &phases = m_profile.GetPhases ();
+        for (uint32_t i = 0; i < phases.size (); i++) {
+            if (phases[i].name == "destroy")
+                continue;
+            std::cerr << "memoryModule,p3";
+            std::cerr << ",nodes,"      << c.GetN ();
+            std::cerr << ",module,"     << phases[i].name;
+            std::cerr << (g_allocationHooks ? ",heapBytes," : ",rssBytes,") << phases[i].liveBytes;
+            std::cerr << ",bytesPerNode," << (double) phases[i].liveBytes / c.GetN ();
+            std::cerr << std::endl;
+        }
+        std::cerr << "memoryPeak,p3,nodes," << c.GetN () << ",peakRss," << PeakResidentBytes () << std::endl;
+    }
+    if (m_warmChild) {
+        m_throughput.Close ();  //_exit runs no destructors
+        std::cout.flush ();
+        std::cerr.flush ();
+        _exit (0);
+    }
+}
+
+//Command line values of one p3 run
+struct P3Config
+{
+    double nodeDensity;
+    uint32_t protocol;
+    double txp;                   //dBm
+    double intensity;
+    double onTime;
+    double offTime;
+    bool batchLoss;
+    bool trafficWheel;
+    bool flowmon;
+    double flowmonSample;
+    std::string flowmonFile;
+    bool setupProfile;
+    bool instrument;
+    std::string eventProfile;     //folded-stack file of the callback profile, empty = off
+    std::string standard;
+    uint32_t channelWidth;        //MHz, 0 = the standard's default
+    uint32_t mcs;
+    bool shortGuard;
+    uint32_t ampdu;               //max A-MPDU bytes, 0 = off
+    uint32_t amsdu;               //max A-MSDU bytes, 0 = off
+    double throughputInterval;    //s
+    std::string throughputFile;   //per-interval throughput stream, empty = none
+    double memoryInterval;        //s between memory samples, 0 = no memory report
+    std::string mobility;         //static, waypoint or walk
+    double minSpeed;              //m/s
+    double maxSpeed;              //m/s
+    double pause;                 //s
+    uint32_t sinkDraw;            //0 = default flow draw
+    std::string warmIntensities;  //comma-separated, warm start when either list is set
+    std::string warmSinkDraws;
+    bool flowsOnly;               //set up and draw the flows, no simulation
+};
+
+//What one experiment (or one component of it) measured
+struct P3Result
+{
+    double efficiency;
+    double throughputMbs;
+    uint64_t rxBytes;
+    uint64_t txBytes;
+    uint64_t offeredBytesPerSource;
+    double networkCap;
+    uint32_t nodes;
+    std::vector<SetupProfile::Phase> phases;
+    std::vector<std::pair<uint32_t, uint32_t> > flows;
+};
+
+//Build and run one experiment, or only one component of it
+static P3Result RunExperiment (const P3Config &cfg, const ComponentPlan *component = 0)
+{
+    AdHocExperiment experiment;
+    experiment = AdHocExperiment (cfg.nodeDensity, cfg.txp, cfg.protocol, cfg.intensity, cfg.onTime, cfg.offTime);
+    if (component)
+        experiment.SetComponent (*component);
+    if (cfg.flowsOnly)
+        experiment.SetFlowsOnly ();
+    if (cfg.setupProfile)
+        experiment.EnableSetupProfile ();
+    if (cfg.instrument)
+        experiment.EnableRunRecord ();
+    if (!cfg.eventProfile.empty ())
+        experiment.EnableEventProfile (cfg.eventProfile);
+    if (cfg.memoryInterval > 0)
+        experiment.EnableMemoryReport (cfg.memoryInterval);
+    experiment.SetTrafficWheel (cfg.trafficWheel);
+    if (cfg.flowmon)
+        experiment.EnableFlowMonitor (cfg.flowmonSample, cfg.flowmonFile);
+    experiment.SetChannelWidth (cfg.channelWidth);
+    experiment.SetThroughputSampling (cfg.throughputInterval, cfg.throughputFile);
+    experiment.SetMobility (cfg.mobility, cfg.minSpeed, cfg.maxSpeed, cfg.pause);
+    experiment.SetSinkDraw (cfg.sinkDraw);
+    if (!cfg.warmIntensities.empty () || !cfg.warmSinkDraws.empty ())
+        experiment.EnableWarmStart (ParseDoubleList (cfg.warmIntensities), ParseDoubleList (cfg.warmSinkDraws));
+    
+    
+    
+    MobilityHelper mobility;
+    WifiHelper wifi = WifiHelper::Default ();
+    NqosWifiMacHelper nqosMac = NqosWifiMacHelper::Default ();
+    HtWifiMacHelper htMac = HtWifiMacHelper::Default ();
+    VhtWifiMacHelper vhtMac = VhtWifiMacHelper::Default ();
+    YansWifiPhyHelper wifiPhy = YansWifiPhyHelper::Default ();
+    YansWifiChannelHelper wifiChannel = YansWifiChannelHelper::Default ();
+    if (cfg.batchLoss) {
+        // Same delay and loss as the default channel, loss evaluated in batches
+        wifiChannel = YansWifiChannelHelper ();
+        wifiChannel.SetPropagationDelay ("ns3::ConstantSpeedPropagationDelayModel");
+        wifiChannel.AddPropagationLoss ("BatchLogDistancePropagationLossModel");
+    }
+    Ssid ssid = Ssid ("Testbed");
+    
+    WifiMacHelper *wifiMac = &nqosMac;
+    if (cfg.standard == "holland") {
+        nqosMac.SetType ("ns3::AdhocWifiMac",
+                         "Ssid", SsidValue (ssid));
+        wifi.SetStandard (WIFI_PHY_STANDARD_holland);
+        wifi.SetRemoteStationManager ("ns3::MinstrelWifiManager");
+    } else {
+        // HT/VHT at a fixed MCS; aggregation needs the QoS MAC
+        QosWifiMacHelper *qosMac;
+        std::ostringstream dataMode, controlMode;
+        if (cfg.standard == "80211ac") {
+            wifi.SetStandard (WIFI_PHY_STANDARD_80211ac);
+            vhtMac.SetType ("ns3::AdhocWifiMac", "Ssid", SsidValue (ssid), "QosSupported", BooleanValue (true),
+                            "HtSupported", BooleanValue (true), "VhtSupported", BooleanValue (true));
+            qosMac = &vhtMac;
+            dataMode << "VhtMcs" << cfg.mcs;
+            controlMode << "VhtMcs0";
+        } else {
+            NS_ABORT_MSG_UNLESS (cfg.standard == "80211n_2_4GHZ" || cfg.standard == "80211n_5GHZ",
+                                 "Invalid standard: use holland, 80211n_2_4GHZ, 80211n_5GHZ or 80211ac");
+            wifi.SetStandard (cfg.standard == "80211n_5GHZ" ? WIFI_PHY_STANDARD_80211n_5GHZ
+                                                            : WIFI_PHY_STANDARD_80211n_2_4GHZ);
+            htMac.SetType ("ns3::AdhocWifiMac", "Ssid", SsidValue (ssid), "QosSupported", BooleanValue (true),
+                           "HtSupported", BooleanValue (true));
+            qosMac = &htMac;
+            dataMode << "HtMcs" << cfg.mcs;
+            controlMode << "HtMcs0";
+        }
+        wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
+                                      "DataMode", StringValue (dataMode.str ()),
+                                      "ControlMode", StringValue (controlMode.str ()));
+        wifiPhy.Set ("ShortGuardEnabled", BooleanValue (cfg.shortGuard));
+        if (cfg.ampdu > 0) {
+            qosMac->SetBlockAckThresholdForAc (AC_BE, 2);
+            qosMac->SetMpduAggregatorForAc (AC_BE, "ns3::MpduStandardAggregator",
+                                            "MaxAmpduSize", UintegerValue (cfg.ampdu));
+        }
+        if (cfg.amsdu > 0) {
+            qosMac->SetMsduAggregatorForAc (AC_BE, "ns3::MsduStandardAggregator",
+                                            "MaxAmsduSize", UintegerValue (cfg.amsdu));
+        }
+        wifiMac = qosMac;
+    }
     
-    return m_output;
+    
+    experiment.Run (wifi, wifiPhy, *wifiMac, wifiChannel, mobility);
+
+    P3Result result;
+    result.efficiency = experiment.CheckEfficiency ();
+    result.throughputMbs = experiment.GetThroughputMbs ();
+    result.rxBytes = experiment.GetRecvBytes ();
+    result.txBytes = experiment.GetSentBytes ();
+    result.offeredBytesPerSource = experiment.GetOfferedBytesPerSource ();
+    result.networkCap = experiment.GetNetworkCapacity ();
+    result.nodes = experiment.GetSimulatedNodes ();
+    result.phases = experiment.GetSetupPhases ();
+    result.flows = experiment.GetFlows ();
+    return result;
+}
+
+//One replication per worker process, seeded with its own run number
+class ReplicationJob
+{
+public:
+    ReplicationJob (const P3Config &cfg, uint32_t firstRun) : m_cfg (cfg), m_firstRun (firstRun) {}
+    std::string operator() (uint32_t replication)
+    {
+        RngSeedManager::SetRun (m_firstRun + replication);
+        P3Config cfg = m_cfg;
+        if (!cfg.throughputFile.empty ())
+        {
+            std::ostringstream name;
+            name << cfg.throughputFile << ".run" << m_firstRun + replication;
+            cfg.throughputFile = name.str ();
+        }
+        if (!cfg.eventProfile.empty ())
+        {
+            std::ostringstream name;
+            name << cfg.eventProfile << ".run" << m_firstRun + replication;
+            cfg.eventProfile = name.str ();
+        }
+        P3Result result = RunExperiment (cfg);
+        std::ostringstream out;
+        out.precision (17);
+        out << result.efficiency << " " << result.throughputMbs;
+        return out.str ();
+    }
+private:
+    P3Config m_cfg;
+    uint32_t m_firstRun;
+};
+
+//Running mean and variance (Welford)
+struct RunningMean
+{
+    RunningMean () : n (0), mean (0), m2 (0) {}
+    void Add (double x)
+    {
+        n++;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+    //Half-width of the two-sided 95% Student-t confidence interval
+    double HalfWidth (void) const
+    {
+        static const double t975[] = { 0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+                                       2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+                                       2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+        if (n < 2)
+            return std::numeric_limits<double>::infinity ();
+        uint32_t df = n - 1;
+        double t = df <= 30 ? t975[df] : 1.96 + 2.5 / df;
+        return t * std::sqrt (m2 / (n - 1) / n);
+    }
+    uint32_t n;
+    double mean;
+    double m2;
+};
+
+/**
+ * Run replications in parallel worker processes until the 95% confidence
+ * intervals of efficiency and throughput are within relWidth of their means
+ * (or maxReplications is reached). Results are consumed in run-number order
+ * so that fast replications finishing first cannot bias the stopping point.
+ */
+static void RunReplications (const P3Config &cfg, uint32_t maxReplications, uint32_t minReplications,
+                             double relWidth, uint32_t jobs)
+{
+    WorkerPool pool (jobs);
+    ReplicationJob job (cfg, RngSeedManager::GetRun ());
+    std::map<uint32_t, std::pair<double, double> > pending;
+    RunningMean efficiency, throughput;
+    uint32_t launched = 0;
+    uint32_t failed = 0;
+    uint32_t consumed = 0;
+    double jobWall = 0;
+    uint32_t jobsDone = 0;
+    bool converged = false;
+    double start = WallSeconds ();
+
+    while (!converged)
+    {
+        while (launched < maxReplications && !pool.IsFull ())
+            pool.Start (launched++, job);
+        WorkerResult result;
+        if (!pool.WaitAny (result))
+            break;
+        jobWall += result.wallSeconds;
+        jobsDone++;
+        std::istringstream in (result.output);
+        double eff, tput;
+        if (!(in >> eff >> tput)) {
+            failed++;
+            eff = tput = std::numeric_limits<double>::quiet_NaN ();
+        }
+        pending[result.job] = std::make_pair (eff, tput);
+
+        // Fold in the contiguous prefix of finished replications
+        while (!pending.empty () && pending.begin ()->first == consumed)
+        {
+            std::pair<double, double> r = pending.begin ()->second;
+            pending.erase (pending.begin ());
+            consumed++;
+            if (r.first != r.first)
+                continue; // failed replication, reported below
+            efficiency.Add (r.first);
+            throughput.Add (r.second);
+            if (efficiency.n >= minReplications
+                && efficiency.HalfWidth () <= relWidth * std::fabs (efficiency.mean)
+                && throughput.HalfWidth () <= relWidth * std::fabs (throughput.mean)) {
+                converged = true;
+                break;
+            }
+        }
+    }
+    pool.KillAll ();
+    double wall = WallSeconds () - start;
+
+    // A fixed count would run maxReplications in waves of pool size
+    double perJob = jobsDone > 0 ? jobWall / jobsDone : 0;
+    double fixedWall = perJob * std::ceil ((double) maxReplications / pool.GetMaxWorkers ());
+
+    std::cout << "replications,"          << efficiency.n;
+    std::cout << ",failed,"               << failed;
+    std::cout << ",converged,"            << converged;
+    std::cout << ",EfficiencyMean,"       << efficiency.mean;
+    std::cout << ",EfficiencyHalfWidth,"  << efficiency.HalfWidth ();
+    std::cout << ",ThroughputMean(Mbs),"  << throughput.mean;
+    std::cout << ",ThroughputHalfWidth,"  << throughput.HalfWidth ();
+    std::cout << ",wall(s),"              << wall;
+    std::cout << ",fixedCountWall(s),"    << fixedWall;
+    std::cout << ",wallSaved(s),"         << std::max (0.0, fixedWall - wall) << std::endl;
+}
+
+//One radio-connected component per worker process
+class ComponentJob
+{
+public:
+    ComponentJob (const P3Config &cfg, const std::vector<ComponentPlan> &plans) : m_cfg (cfg), m_plans (plans) {}
+    std::string operator() (uint32_t k)
+    {
+        P3Config cfg = m_cfg;
+        if (!cfg.throughputFile.empty ())
+        {
+            std::ostringstream name;
+            name << cfg.throughputFile << ".component" << k;
+            cfg.throughputFile = name.str ();
+        }
+        if (!cfg.eventProfile.empty ())
+        {
+            std::ostringstream name;
+            name << cfg.eventProfile << ".component" << k;
+            cfg.eventProfile = name.str ();
+        }
+        P3Result result = RunExperiment (cfg, &m_plans[k]);
+        std::ostringstream out;
+        out.precision (17);
+        out << result.rxBytes << " " << result.txBytes << " " << result.offeredBytesPerSource
+            << " " << result.networkCap;
+        return out.str ();
+    }
+private:
+    P3Config m_cfg;
+    const std::vector<ComponentPlan> &m_plans;
+};
+
+//Initial value of a double attribute, read without instantiating the type
+static double GetAttributeDefault (std::string typeName, std::string attribute)
+{
+    struct TypeId::AttributeInformation info;
+    TypeId::LookupByName (typeName).LookupAttributeByName (attribute, &info);
+    return DynamicCast<const DoubleValue> (info.initialValue)->Get ();
+}
+
+/**
+ * Simulate each radio-connected component of the map as its own experiment
+ * in parallel worker processes and merge the byte counts into one line.
+ * Nodes in different components can never exchange frames, so nothing is
+ * lost by separating them. Flows that cross components are reported as
+ * unreachable together with the bytes their sources would have offered;
+ * components without an intra-component flow are not simulated.
+ */
+static void RunComponents (const P3Config &cfg, uint32_t jobs, bool checkFlows)
+{
+    double start = WallSeconds ();
+    double range = RadioRange (cfg.txp + GetAttributeDefault ("ns3::YansWifiPhy", "TxGain")
+                               + GetAttributeDefault ("ns3::YansWifiPhy", "RxGain"),
+                               GetAttributeDefault ("ns3::YansWifiPhy", "EnergyDetectionThreshold"),
+                               DefaultLogDistanceParams ());
+    AdHocExperiment planner (cfg.nodeDensity, cfg.txp, cfg.protocol, cfg.intensity, cfg.onTime, cfg.offTime);
+    planner.SetSinkDraw (cfg.sinkDraw);
+    std::vector<ComponentPlan> plans;
+    uint32_t unreachable = planner.PlanComponents (range, plans);
+
+    // Largest components first so the long runs start early
+    std::vector<std::pair<uint32_t, uint32_t> > order;
+    for (uint32_t k = 0; k < plans.size (); k++)
+        if (!plans[k].flows.empty ())
+            order.push_back (std::make_pair (plans[k].nodes.size (), k));
+    std::sort (order.rbegin (), order.rend ());
+
+    WorkerPool pool (jobs);
+    ComponentJob job (cfg, plans);
+    uint64_t rxBytes = 0, txBytes = 0, offeredPerSource = 0;
+    double networkCap = 0;
+    uint32_t next = 0, failed = 0;
+    while (true)
+    {
+        while (next < order.size () && !pool.IsFull ())
+            pool.Start (order[next++].second, job);
+        WorkerResult result;
+        if (!pool.WaitAny (result))
+            break;
+        std::istringstream in (result.output);
+        uint64_t rx, tx, offered;
+        double cap;
+        if (!(in >> rx >> tx >> offered >> cap)) {
+            failed++;
+            continue;
+        }
+        rxBytes += rx;
+        txBytes += tx;
+        offeredPerSource = offered;
+        networkCap = cap;
+    }
+
+    // A single run draws its flows only after the whole setup; it must get the same list
+    if (checkFlows) {
+        P3Config single = cfg;
+        single.flowsOnly = true;
+        single.setupProfile = false;
+        single.instrument = false;
+        single.memoryInterval = 0;
+        NS_ABORT_MSG_IF (RunExperiment (single).flows != planner.GetFlows (),
+                         "--checkFlows: component mode drew other flows than a single run");
+    }
+
+    std::cout << "nodeDensity,"   << cfg.nodeDensity;
+    std::cout << ",protocol,"     << cfg.protocol;
+    std::cout << ",txp(dBm/n),"   << cfg.txp;
+    std::cout << ",intensity,"    << cfg.intensity;
+    std::cout << ",Efficiency, "  << ((rxBytes == 0 || txBytes == 0) ? 0 : rxBytes / (double) txBytes);
+    std::cout << ",totalRxBytes," << rxBytes;
+    std::cout << ",totalTxBytes," << txBytes;
+    std::cout << ",Network Capacity(Mbs)," << networkCap/1000000;
+    std::cout << ",components,"   << plans.size ();
+    std::cout << ",simulatedComponents," << order.size ();
+    std::cout << ",failedComponents,"    << failed;
+    std::cout << ",unreachableFlows,"    << unreachable;
+    if (checkFlows)
+        std::cout << ",flowsChecked,"    << planner.GetFlows ().size ();
+    std::cout << ",unreachableOfferedBytes," << (uint64_t) unreachable * offeredPerSource;
+    std::cout << ",wall(s),"      << WallSeconds () - start << std::endl;
+}
+
+/**
+ * Wall time of the same scenario with static nodes, random waypoint and
+ * random walk. Mobile positions are evaluated only when the channel asks,
+ * so the difference is the cost of the moving receivers in the loss model
+ * and of the routing churn the motion causes.
+ */
+static void BenchMobility (const P3Config &cfg, uint32_t nodes)
+{
+    const char *models[] = { "static", "waypoint", "walk" };
+    double wall[3];
+    P3Config bench = cfg;
+    bench.nodeDensity = nodes / 1000000.0;  //on the 1000 x 1000 map
+    for (uint32_t m = 0; m < 3; m++)
+    {
+        bench.mobility = models[m];
+        double start = WallSeconds ();
+        RunExperiment (bench);
+        wall[m] = WallSeconds () - start;
+    }
+    std::cout << "mobilityBench,nodes," << nodes;
+    std::cout << ",protocol,"    << cfg.protocol;
+    std::cout << ",batchLoss,"   << cfg.batchLoss;
+    for (uint32_t m = 0; m < 3; m++)
+        std::cout << "," << models[m] << "(s)," << wall[m];
+    std::cout << ",waypointSlowdown," << wall[1] / wall[0];
+    std::cout << ",walkSlowdown,"     << wall[2] / wall[0] << std::endl;
+}
+
+/**
+ * Micro-benchmark cases for the application setup and the two traffic
+ * drivers. Nodes get the internet stack and SimpleNetDevices on a shared
+ * SimpleChannel instead of Wi-Fi: none of the code under test looks at the
+ * PHY, and building a Wi-Fi grid per sample would dominate the run.
+ */
+class SetupBench
+{
+public:
+    enum Part { DRAW_FLOWS, APPLICATION_SETUP, SELECT_SRC_DEST, GENERATE_TRAFFIC, TRAFFIC_WHEEL };
+
+    SetupBench (const P3Config &cfg, Part part, uint32_t nodes, uint32_t packets) :
+    m_cfg (cfg), m_part (part), m_nodes (nodes), m_packets (packets), m_dataRate (0)
+    {
+    }
+
+    void Prepare ()
+    {
+        m_experiment = AdHocExperiment (m_cfg.nodeDensity, m_cfg.txp, m_cfg.protocol, m_cfg.intensity, m_cfg.onTime, m_cfg.offTime);
+        m_experiment.SetTrafficWheel (m_part != GENERATE_TRAFFIC);
+        m_container = NodeContainer ();
+        m_container.Create (m_nodes);
+        InternetStackHelper internet;
+        internet.Install (m_container);
+        SimpleNetDeviceHelper simple;
+        NetDeviceContainer devices = simple.Install (m_container);
+        Ipv4AddressHelper address;
+        address.SetBase ("10.0.0.0", "255.255.0.0");
+        m_experiment.m_interfaces = address.Assign (devices);
+
+        //Setup cases: a hundred packets per flow, never sent
+        m_dataRate = (uint64_t) (m_packets > 0 ? m_packets : 100) * m_experiment.m_packetSize;
+        if (m_part == APPLICATION_SETUP)
+            m_experiment.m_flows = m_experiment.DrawFlows (m_nodes);
+        if (m_part == GENERATE_TRAFFIC || m_part == TRAFFIC_WHEEL) {
+            //One flow, so the run is the per-packet cost of the driver
+            m_experiment.m_flows.assign (1, std::make_pair (0u, 1u));
+            m_experiment.SelectSrcDest (m_container, m_dataRate);
+            Simulator::Stop (Seconds (m_experiment.m_trafficStart + 10.0));
+        }
+    }
+
+    void Run ()
+    {
+        switch (m_part) {
+        case DRAW_FLOWS:
+            m_drawn = m_experiment.DrawFlows (m_nodes);
+            break;
+        case APPLICATION_SETUP:
+            for (uint32_t f = 0; f < m_experiment.m_flows.size (); f++) {
+                uint32_t dst = m_experiment.m_flows[f].second;
+                m_experiment.ApplicationSetup (m_container.Get (m_experiment.m_flows[f].first), m_container.Get (dst),
+                                               m_experiment.m_interfaces.GetAddress (dst), 0, m_experiment.m_totalTime, m_dataRate);
+            }
+            break;
+        case SELECT_SRC_DEST:
+            m_experiment.SelectSrcDest (m_container, m_dataRate);
+            break;
+        default:
+            Simulator::Run ();
+            break;
+        }
+    }
+
+    void Cleanup ()
+    {
+        m_container = NodeContainer ();
+        m_experiment = AdHocExperiment ();
+        Simulator::Destroy ();
+        Ipv4AddressGenerator::Reset ();  //the next sample assigns the same subnet
+    }
+
+private:
+    P3Config m_cfg;
+    Part m_part;
+    uint32_t m_nodes;
+    uint32_t m_packets;
+    uint64_t m_dataRate;
+    AdHocExperiment m_experiment;
+    NodeContainer m_container;
+    std::vector<std::pair<uint32_t, uint32_t> > m_drawn;
+};
+
+/**
+ * Setup cost against node count (perUnit is per node, i.e. per flow) and
+ * per-packet cost of GenerateTraffic against the timer wheel. The setup
+ * cases should stay flat per node; growth there is a lookup that scales
+ * with the node list.
+ */
+static void BenchSetup (const P3Config &cfg, const std::string &list)
+{
+    MicroBench bench ("p3");
+    std::vector<double> sizes = ParseDoubleList (list);
+    const char *names[] = { "DrawFlows", "ApplicationSetup", "SelectSrcDest" };
+    for (uint32_t i = 0; i < sizes.size (); i++)
+    {
+        uint32_t nodes = (uint32_t) sizes[i];
+        NS_ABORT_MSG_IF (nodes < 2 || nodes > 65000, "--benchSetup node counts must be in [2, 65000]");
+        for (uint32_t p = SetupBench::DRAW_FLOWS; p <= SetupBench::SELECT_SRC_DEST; p++)
+        {
+            SetupBench setup (cfg, (SetupBench::Part) p, nodes, 0);
+            bench.Measure (names[p], nodes, setup, nodes);
+        }
+    }
+    const uint32_t packets = 10000;
+    SetupBench plain (cfg, SetupBench::GENERATE_TRAFFIC, 2, packets);
+    bench.Measure ("GenerateTraffic", packets, plain, packets);
+    SetupBench wheel (cfg, SetupBench::TRAFFIC_WHEEL, 2, packets);
+    bench.Measure ("PeriodicTrafficWheel", packets, wheel, packets);
+}
+
+//One memory sweep point per worker process, so each starts from a clean heap
+class MemorySweepJob
+{
+public:
+    MemorySweepJob (const P3Config &cfg, const std::vector<double> &densities) : m_cfg (cfg), m_densities (densities) {}
+    std::string operator() (uint32_t k)
+    {
+        P3Config cfg = m_cfg;
+        cfg.nodeDensity = m_densities[k];
+        P3Result result = RunExperiment (cfg);
+        std::ostringstream out;
+        out << result.nodes << " " << PeakResidentBytes ();
+        for (uint32_t i = 0; i < result.phases.size (); i++)
+            out << " " << result.phases[i].name << " " << result.phases[i].liveBytes;
+        return out.str ();
+    }
+private:
+    P3Config m_cfg;
+    std::vector<double> m_densities;
+};
+
+/**
+ * Heap growth per module for a list of node densities. Besides bytes per
+ * node at each point, the marginal bytes per added node between consecutive
+ * points show which module grows faster than linearly (e.g. OLSR tables
+ * filling up during "run").
+ */
+static void RunMemorySweep (const P3Config &cfg, const std::string &list, uint32_t jobs)
+{
+    std::vector<double> densities = ParseDoubleList (list);
+
+    WorkerPool pool (jobs);
+    MemorySweepJob job (cfg, densities);
+    // points[k]: nodes, peak RSS and memory growth by module for densities[k]
+    std::vector<std::pair<uint32_t, uint64_t> > points (densities.size (), std::make_pair (0, 0));
+    std::vector<std::map<std::string, int64_t> > modules (densities.size ());
+    std::vector<std::string> moduleOrder;
+    uint32_t next = 0;
+    while (true)
+    {
+        while (next < densities.size () && !pool.IsFull ())
+            pool.Start (next++, job);
+        WorkerResult result;
+        if (!pool.WaitAny (result))
+            break;
+        std::istringstream out (result.output);
+        out >> points[result.job].first >> points[result.job].second;
+        std::string name;
+        int64_t bytes;
+        while (out >> name >> bytes) {
+            if (name == "destroy")
+                continue;
+            modules[result.job][name] = bytes;
+            if (std::find (moduleOrder.begin (), moduleOrder.end (), name) == moduleOrder.end ())
+                moduleOrder.push_back (name);
+        }
+    }
+
+    for (uint32_t k = 0; k < densities.size (); k++)
+    {
+        uint32_t nodes = points[k].first;
+        if (nodes == 0) {
+            std::cout << "memorySweep,nodeDensity," << densities[k] << ",failed" << std::endl;
+            continue;
+        }
+        std::cout << "memorySweep,nodeDensity," << densities[k];
+        std::cout << ",nodes,"   << nodes;
+        std::cout << ",peakRss," << points[k].second;
+        std::cout << ",peakRssPerNode," << (double) points[k].second / nodes;
+        for (uint32_t m = 0; m < moduleOrder.size (); m++) {
+            int64_t bytes = modules[k][moduleOrder[m]];
+            std::cout << "," << moduleOrder[m] << "PerNode," << (double) bytes / nodes;
+            // Marginal cost against the previous successful point
+            for (int32_t j = (int32_t) k - 1; j >= 0; j--) {
+                if (points[j].first == 0 || points[j].first == nodes)
+                    continue;
+                std::cout << "," << moduleOrder[m] << "Marginal,"
+                          << (double) (bytes - modules[j][moduleOrder[m]]) / ((double) nodes - points[j].first);
+                break;
+            }
+        }
+        std::cout << std::endl;
+    }
 }
 
 int main (int argc, char* argv[]) {
@@ -320,22 +2866,101 @@ int main (int argc, char* argv[]) {
     RngSeedManager::SetSeed (11223344); //Change Seed to the one the instructor provided
     
     
-    double nodeDensity = 0.00002; //0.00002 * 10^6 = 20 nodes
-    uint32_t protocol = 0;        //OSLR default
-    double txp= 500.0;            //Default transmission power
-    double intensity = 0.1;       //Default traffic intensity
+    P3Config cfg;
+    cfg.nodeDensity = 0.00002; //0.00002 * 10^6 = 20 nodes
+    cfg.protocol = 0;          //OSLR default
+    double txp= 500.0;         //Default transmission power
+    cfg.intensity = 0.1;       //Default traffic intensity
 
-    double onTime = 0.1; //onoff application onTime
-    double offTime = 0.1; //onoff application offTime
+    cfg.onTime = 0.1; //onoff application onTime
+    cfg.offTime = 0.1; //onoff application offTime
+    cfg.batchLoss = false;       //Batched received-power loss model
+    uint32_t benchRxPower = 0;   //Receivers per call for the kernel benchmark, 0 = off
+    cfg.trafficWheel = true;     //Serve all sources from one timer wheel
+    cfg.flowmon = false;         //Per-flow statistics from FlowMonitor
+    cfg.flowmonSample = 1.0;     //Fraction of flows monitored
+    cfg.flowmonFile = "P3Experiment.flows";
+    uint32_t replications = 0;   //Max replications for the parallel runner, 0 = single run
+    uint32_t minReplications = 3;
+    double ciRelWidth = 0.05;    //Target CI half-width relative to the mean
+    uint32_t jobs = 0;           //Worker processes, 0 = all cores
+    bool components = false;     //Simulate radio-connected components separately
+    bool checkFlows = false;     //Check the component flows against a single run's
+    cfg.setupProfile = false;    //Wall time and memory per setup phase
+    cfg.instrument = false;      //One record of phase times and event rate per run
+    cfg.eventProfile = "";
+    cfg.standard = "holland";    //PHY standard
+    cfg.channelWidth = 0;        //MHz, 0 = the standard's default
+    cfg.mcs = 7;                 //HT/VHT MCS index
+    cfg.shortGuard = false;
+    cfg.ampdu = 0;
+    cfg.amsdu = 0;
+    cfg.throughputInterval = 0.1; //Throughput sampling period (s)
+    cfg.throughputFile = "";
+    cfg.memoryInterval = 0;       //Memory sampling period (s), 0 = off
+    std::string memorySweep = ""; //Comma-separated node densities for the memory sweep
+    cfg.mobility = "static";      //Node motion
+    cfg.minSpeed = 0.5;
+    cfg.maxSpeed = 5.0;
+    cfg.pause = 1.0;
+    uint32_t benchMobility = 0;   //Nodes for the mobile vs static benchmark, 0 = off
+    std::string benchSetup;       //Comma-separated node counts for the setup micro-benchmarks, empty = off
+    cfg.sinkDraw = 0;
+    cfg.warmIntensities = "";
+    cfg.warmSinkDraws = "";
+    cfg.flowsOnly = false;
     
     //Get Command line values
     CommandLine cmd;
-    cmd.AddValue("nodeDensity", "Number of Nodes per unit aream (1000m by 1000m)", nodeDensity);
-    cmd.AddValue("protocol", "0 = OLSR, 1 = AODV", protocol);
+    cmd.AddValue("nodeDensity", "Number of Nodes per unit aream (1000m by 1000m)", cfg.nodeDensity);
+    cmd.AddValue("protocol", "0 = OLSR, 1 = AODV, 2 = precomputed static shortest paths", cfg.protocol);
     cmd.AddValue("txp", "Transmission Power", txp);
-    cmd.AddValue("intensity", "Traffic Intensity", intensity);
+    cmd.AddValue("intensity", "Traffic Intensity", cfg.intensity);
+    cmd.AddValue("batchLoss", "Evaluate log-distance loss for all receivers at once", cfg.batchLoss);
+    cmd.AddValue("trafficWheel", "Send periodic traffic from one timer wheel instead of per-source events", cfg.trafficWheel);
+    cmd.AddValue("flowmon", "Collect per-flow throughput, delay and loss", cfg.flowmon);
+    cmd.AddValue("flowmonSample", "Fraction of flows to monitor (stride sampled)", cfg.flowmonSample);
+    cmd.AddValue("flowmonFile", "Per-flow output file", cfg.flowmonFile);
+    cmd.AddValue("replications", "Run up to this many replications in parallel, stopping on CI width", replications);
+    cmd.AddValue("minReplications", "Replications before the CI stopping rule applies", minReplications);
+    cmd.AddValue("ciRelWidth", "Target 95% CI half-width as a fraction of the mean", ciRelWidth);
+    cmd.AddValue("jobs", "Parallel worker processes (0 = all cores)", jobs);
+    cmd.AddValue("standard", "holland, 80211n_2_4GHZ, 80211n_5GHZ or 80211ac", cfg.standard);
+    cmd.AddValue("channelWidth", "Channel width in MHz (40 and up need HT/VHT), 0 = the standard's default (80 for 80211ac, else 20)", cfg.channelWidth);
+    cmd.AddValue("mcs", "HT/VHT MCS index used for data frames", cfg.mcs);
+    cmd.AddValue("shortGuard", "Use the short guard interval (HT/VHT)", cfg.shortGuard);
+    cmd.AddValue("ampdu", "Max A-MPDU size in bytes, 0 = no A-MPDU (HT/VHT)", cfg.ampdu);
+    cmd.AddValue("amsdu", "Max A-MSDU size in bytes, 0 = no A-MSDU (HT/VHT)", cfg.amsdu);
+    cmd.AddValue("throughputInterval", "Throughput sampling period in seconds", cfg.throughputInterval);
+    cmd.AddValue("throughputFile", "Stream per-interval throughput to this file (suffixed per replication/component; columnar if it ends in .tsc)", cfg.throughputFile);
+    cmd.AddValue("memoryInterval", "Report memory per module and sample it at this period (s), 0 = off", cfg.memoryInterval);
+    cmd.AddValue("memorySweep", "Comma-separated node densities: report memory per node for each and exit", memorySweep);
+    cmd.AddValue("mobility", "static, waypoint (random waypoint) or walk (random walk)", cfg.mobility);
+    cmd.AddValue("minSpeed", "Lowest node speed in m/s (mobile runs)", cfg.minSpeed);
+    cmd.AddValue("maxSpeed", "Highest node speed in m/s (mobile runs)", cfg.maxSpeed);
+    cmd.AddValue("pause", "Pause at each waypoint in seconds", cfg.pause);
+    cmd.AddValue("benchMobility", "Compare run time of static and mobile runs with this many nodes and exit", benchMobility);
+    cmd.AddValue("benchSetup", "Micro-benchmark flow and application setup at these comma-separated node counts, and the traffic drivers, then exit", benchSetup);
+    cmd.AddValue("sinkDraw", "Alternative random choice of sinks (0 = default)", cfg.sinkDraw);
+    cmd.AddValue("warmIntensities", "Converge routing once, then fork one run per intensity in this list", cfg.warmIntensities);
+    cmd.AddValue("warmSinkDraws", "Sink draws to fork after the shared warm-up (crossed with warmIntensities)", cfg.warmSinkDraws);
+    cmd.AddValue("setupProfile", "Print wall time and memory of each setup phase to stderr", cfg.setupProfile);
+    cmd.AddValue("instrument", "Print phase wall times and event rates of each run to stderr", cfg.instrument);
+    cmd.AddValue("eventProfile", "Profile event callbacks: ranked table on stderr, folded stacks to this file (suffixed per replication/component)", cfg.eventProfile);
+    cmd.AddValue("components", "Simulate each radio-connected component in its own process", components);
+    cmd.AddValue("checkFlows", "With --components: abort unless a single run would draw the same flows", checkFlows);
+    cmd.AddValue("benchRxPower", "Benchmark the received-power kernel with this many receivers and exit", benchRxPower);
     
     cmd.Parse(argc, argv);
+    if (!cfg.eventProfile.empty ())
+        EnableEventProfile ();
+    else if (cfg.instrument)
+        EnableEventCounting ();
+
+    if (benchRxPower > 0) {
+        BenchRxPower (benchRxPower);
+        return 0;
+    }
     //Config::SetDefault  ("ns3::OnOffApplication::PacketSize",StringValue (psize));
     //Config::SetDefault ("ns3::OnOffApplication::DataRate",  StringValue (rate));
     //Config::SetDefault ("ns3::WifiRemoteStationManager::FragmentationThreshold", StringValue ("2200"));
@@ -345,39 +2970,62 @@ int main (int argc, char* argv[]) {
     std::ofstream outfile (("P3Experiment.plt"));
 
     
-    if(protocol == 1) {
-        protocol = 1;
-    } else {
-        protocol = 0;
+    if(cfg.protocol > 2) {
+        cfg.protocol = 0;
     }
     
-    txp = 10*(log10(txp));
+    cfg.txp = 10*(log10(txp));
     //std::cout << "txp is "<< txp <<"in dBm\n";
-    AdHocExperiment experiment;
-    experiment = AdHocExperiment (nodeDensity, txp, protocol, intensity, onTime, offTime);
-    
-    
-    
-    MobilityHelper mobility;
-    //Gnuplot gnuplot;
-    Gnuplot2dDataset dataset;
-    
-    WifiHelper wifi = WifiHelper::Default ();
-    NqosWifiMacHelper wifiMac = NqosWifiMacHelper::Default ();
-    YansWifiPhyHelper wifiPhy = YansWifiPhyHelper::Default ();
-    YansWifiChannelHelper wifiChannel = YansWifiChannelHelper::Default ();
-    Ssid ssid = Ssid ("Testbed");
-    
-    wifiMac.SetType ("ns3::AdhocWifiMac",
-                     "Ssid", SsidValue (ssid));
-    wifi.SetStandard (WIFI_PHY_STANDARD_holland);
-    wifi.SetRemoteStationManager ("ns3::MinstrelWifiManager");
-    
-    
-    dataset = experiment.Run (wifi, wifiPhy, wifiMac, wifiChannel, mobility);
-    
-    //gnuplot.AddDataset (dataset);
-    //gnuplot.GenerateOutput (outfile);
+
+    if (benchMobility > 0) {
+        BenchMobility (cfg, benchMobility);
+        return 0;
+    }
+    if (!benchSetup.empty ()) {
+        BenchSetup (cfg, benchSetup);
+        return 0;
+    }
+
+    NS_ABORT_MSG_IF (components && cfg.mobility != "static", "--components needs static nodes");
+    NS_ABORT_MSG_IF ((!cfg.warmIntensities.empty () || !cfg.warmSinkDraws.empty ())
+                     && (replications > 0 || components || !memorySweep.empty ()),
+                     "Warm start runs on its own, without replications, components or a memory sweep");
+
+    if (replications > 0) {
+        RunReplications (cfg, replications, minReplications, ciRelWidth, jobs);
+        return 0;
+    }
+
+    if (components) {
+        RunComponents (cfg, jobs, checkFlows);
+        return 0;
+    }
+
+    if (!memorySweep.empty ()) {
+        RunMemorySweep (cfg, memorySweep, jobs);
+        return 0;
+    }
+
+    // Single runs are looked up in the result cache (SCENARIO_CACHE_DIR);
+    // warm-start variants print from their own processes and are not cached
+    if (!cfg.warmIntensities.empty () || !cfg.warmSinkDraws.empty ()) {
+        RunExperiment (cfg);
+        return 0;
+    }
+    //Progress file when SCENARIO_STATUS_FILE is set; the forking modes above do not report
+    StatusTelemetry status ("p3");
+    ResultCache cache ("p3", argc, argv);
+    if (!cfg.throughputFile.empty ())
+        cache.AddOutputFile (cfg.throughputFile);
+    if (cfg.flowmon)
+        cache.AddOutputFile (cfg.flowmonFile);
+    // These report on stderr about this very run
+    if (cfg.setupProfile || cfg.instrument || !cfg.eventProfile.empty () || cfg.memoryInterval > 0)
+        cache.Bypass ("profiling");
+    if (!cache.Replay ()) {
+        RunExperiment (cfg);
+        cache.Store ();
+    }
 
     
     return 0;
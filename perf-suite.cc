@@ -0,0 +1,463 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Performance regression suite for the scenario programs.
+//
+// Runs a fixed set of representative configurations of p1, p2, Ip2 and p3
+// one after another (never in parallel, so they do not disturb each other),
+// each with --instrument, and takes the median over the repeats of the
+// scenario's own runProfile record (scenario-instrument.h): wall time from
+// setup to Destroy, events per wall-second of Simulator::Run and peak RSS.
+// Process startup and the build tool's overhead are left out.
+//
+// Results go to a JSON file. Given a baseline written by an earlier run,
+// every case is compared with it and the suite fails (exit status 1) when
+// a case got slower, processes fewer events per second or needs more
+// memory by more than the threshold. Cases missing from the baseline are
+// reported but never fail.
+//
+// Usage: perf-suite [--command=<template>] [--baseline=<json>]
+//                   [--output=<json>] [--threshold=<fraction>]
+//                   [--repeats=<n>] [--only=<scenario,...>]
+//
+//   --command    how to run one scenario; {scenario} and {args} are
+//                replaced (default: ./waf --run "{scenario} {args}")
+//   --baseline   results to compare with (default: none)
+//   --output     where to write the results (default: perf-results.json)
+//   --threshold  allowed relative regression (default: 0.10)
+//   --repeats    runs per case, the median is kept (default: 3)
+//   --only       run only the cases of these scenarios
+//
+// The result cache and the status file are switched off for the runs.
+// To accept new numbers, use the output of a clean run as the baseline.
+//
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+struct BenchCase
+{
+  std::string name;
+  std::string scenario;
+  std::string args;
+};
+
+struct BenchResult
+{
+  std::string name;
+  std::string scenario;
+  std::string args;
+  uint32_t runs;      // repeats that produced a record
+  double wall;        // s, median
+  double eventsPerSecond;
+  double events;
+  double peakRss;     // bytes
+};
+
+static void
+AddCase (std::vector<BenchCase> &cases, const std::string &name,
+         const std::string &scenario, const std::string &args)
+{
+  BenchCase c;
+  c.name = name;
+  c.scenario = scenario;
+  c.args = args;
+  cases.push_back (c);
+}
+
+// The fixed configurations; keep names stable, baselines are keyed by them
+static std::vector<BenchCase>
+SuiteCases (void)
+{
+  std::vector<BenchCase> cases;
+  // Dumbbell at the smallest segment size, up to the 10 flows p1 supports
+  AddCase (cases, "p1-seg128-flows1", "p1", "--segSize=128 --nFlows=1");
+  AddCase (cases, "p1-seg128-flows5", "p1", "--segSize=128 --nFlows=5");
+  AddCase (cases, "p1-seg128-flows10", "p1", "--segSize=128 --nFlows=10");
+  const char *queues[] = { "DropTail", "RED" };
+  const char *loads[] = { "0.5", "0.9" };
+  for (uint32_t q = 0; q < 2; q++)
+    {
+      for (uint32_t l = 0; l < 2; l++)
+        {
+          std::string suffix = std::string (queues[q]) + "-load" + loads[l];
+          AddCase (cases, "p2-" + suffix, "p2",
+                   std::string ("--queue=") + queues[q] + " --load=" + loads[l]);
+          AddCase (cases, "Ip2-" + suffix, "Ip2",
+                   std::string ("--queueType=") + queues[q] + " --load=" + loads[l]);
+        }
+    }
+  // 20, 200 and 2000 nodes on the 1000 x 1000 grid
+  const char *densities[] = { "0.00002", "0.0002", "0.002" };
+  const char *nodes[] = { "20", "200", "2000" };
+  const char *protocols[] = { "olsr", "aodv" };
+  for (uint32_t d = 0; d < 3; d++)
+    {
+      for (uint32_t p = 0; p < 2; p++)
+        {
+          std::ostringstream args;
+          args << "--nodeDensity=" << densities[d] << " --protocol=" << p;
+          AddCase (cases, std::string ("p3-") + nodes[d] + "-" + protocols[p], "p3", args.str ());
+        }
+    }
+  return cases;
+}
+
+static std::string
+Replace (std::string text, const std::string &from, const std::string &to)
+{
+  size_t at = text.find (from);
+  if (at != std::string::npos)
+    {
+      text.replace (at, from.size (), to);
+    }
+  return text;
+}
+
+// "runProfile,<scenario>,key,value,..." as key -> value
+static std::map<std::string, double>
+ParseRecord (const std::string &line)
+{
+  std::map<std::string, double> fields;
+  std::vector<std::string> tokens;
+  std::istringstream in (line);
+  std::string token;
+  while (std::getline (in, token, ','))
+    {
+      tokens.push_back (token);
+    }
+  for (uint32_t i = 2; i + 1 < tokens.size (); i += 2)
+    {
+      fields[tokens[i]] = atof (tokens[i + 1].c_str ());
+    }
+  return fields;
+}
+
+/**
+ * Run one case once; stdout is discarded, stderr searched for the last
+ * runProfile record. False if the run failed or printed no record.
+ */
+static bool
+RunOnce (const std::string &command, std::map<std::string, double> &record)
+{
+  int fds[2];
+  if (pipe (fds) != 0)
+    {
+      return false;
+    }
+  std::cout.flush ();
+  pid_t pid = fork ();
+  if (pid < 0)
+    {
+      close (fds[0]);
+      close (fds[1]);
+      return false;
+    }
+  if (pid == 0)
+    {
+      close (fds[0]);
+      dup2 (fds[1], 2);
+      close (fds[1]);
+      FILE *null = fopen ("/dev/null", "w");
+      if (null)
+        {
+          dup2 (fileno (null), 1);
+        }
+      // Measure the simulation, not a cache lookup
+      unsetenv ("SCENARIO_CACHE_DIR");
+      unsetenv ("SCENARIO_STATUS_FILE");
+      execl ("/bin/sh", "sh", "-c", command.c_str (), (char *) 0);
+      _exit (127);
+    }
+  close (fds[1]);
+  std::string err;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read (fds[0], buf, sizeof (buf))) != 0)
+    {
+      if (n > 0)
+        {
+          err.append (buf, n);
+        }
+      else if (errno != EINTR)
+        {
+          break;
+        }
+    }
+  close (fds[0]);
+  int status = -1;
+  waitpid (pid, &status, 0);
+  if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    {
+      return false;
+    }
+  std::istringstream lines (err);
+  std::string line;
+  bool found = false;
+  while (std::getline (lines, line))
+    {
+      if (line.compare (0, 11, "runProfile,") == 0)
+        {
+          record = ParseRecord (line);
+          found = true;
+        }
+    }
+  return found;
+}
+
+static double
+Median (std::vector<double> values)
+{
+  if (values.empty ())
+    {
+      return 0;
+    }
+  std::sort (values.begin (), values.end ());
+  uint32_t mid = values.size () / 2;
+  return values.size () % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+static std::string
+JsonString (const std::string &text)
+{
+  std::string out = "\"";
+  for (uint32_t i = 0; i < text.size (); i++)
+    {
+      if (text[i] == '"' || text[i] == '\\')
+        {
+          out += '\\';
+        }
+      out += text[i];
+    }
+  return out + "\"";
+}
+
+// One case per line, so ReadResults () needs no JSON parser
+static void
+WriteResults (const std::string &fileName, const std::vector<BenchResult> &results, double threshold)
+{
+  std::ofstream out (fileName.c_str ());
+  out.precision (10);
+  out << "{\n  \"suite\": \"scenario-perf\",\n  \"threshold\": " << threshold << ",\n  \"results\": [\n";
+  for (uint32_t i = 0; i < results.size (); i++)
+    {
+      const BenchResult &r = results[i];
+      out << "    {\"name\": " << JsonString (r.name);
+      out << ", \"scenario\": " << JsonString (r.scenario);
+      out << ", \"args\": " << JsonString (r.args);
+      out << ", \"runs\": " << r.runs;
+      out << ", \"wall\": " << r.wall;
+      out << ", \"eventsPerSecond\": " << r.eventsPerSecond;
+      out << ", \"events\": " << r.events;
+      out << ", \"peakRss\": " << r.peakRss;
+      out << "}" << (i + 1 < results.size () ? "," : "") << "\n";
+    }
+  out << "  ]\n}\n";
+}
+
+static double
+JsonNumber (const std::string &line, const std::string &key)
+{
+  size_t at = line.find ("\"" + key + "\":");
+  return at == std::string::npos ? -1 : atof (line.c_str () + at + key.size () + 3);
+}
+
+static std::string
+JsonText (const std::string &line, const std::string &key)
+{
+  size_t at = line.find ("\"" + key + "\": \"");
+  if (at == std::string::npos)
+    {
+      return "";
+    }
+  at += key.size () + 5;
+  return line.substr (at, line.find ('"', at) - at);
+}
+
+// Results written by WriteResults (), by case name
+static std::map<std::string, BenchResult>
+ReadResults (const std::string &fileName, bool &ok)
+{
+  std::map<std::string, BenchResult> results;
+  std::ifstream in (fileName.c_str ());
+  ok = in.good ();
+  std::string line;
+  while (std::getline (in, line))
+    {
+      BenchResult r;
+      r.name = JsonText (line, "name");
+      if (r.name.empty ())
+        {
+          continue;
+        }
+      r.scenario = JsonText (line, "scenario");
+      r.args = JsonText (line, "args");
+      r.runs = (uint32_t) JsonNumber (line, "runs");
+      r.wall = JsonNumber (line, "wall");
+      r.eventsPerSecond = JsonNumber (line, "eventsPerSecond");
+      r.events = JsonNumber (line, "events");
+      r.peakRss = JsonNumber (line, "peakRss");
+      results[r.name] = r;
+    }
+  return results;
+}
+
+static bool
+Option (const char *arg, const char *name, std::string &value)
+{
+  size_t n = strlen (name);
+  if (strncmp (arg, name, n) == 0 && arg[n] == '=')
+    {
+      value = arg + n + 1;
+      return true;
+    }
+  return false;
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string command = "./waf --run \"{scenario} {args}\"";
+  std::string baselineFile;
+  std::string outputFile = "perf-results.json";
+  double threshold = 0.10;
+  uint32_t repeats = 3;
+  std::string only;
+  for (int i = 1; i < argc; i++)
+    {
+      std::string value;
+      if (Option (argv[i], "--command", value))
+        {
+          command = value;
+        }
+      else if (Option (argv[i], "--baseline", value))
+        {
+          baselineFile = value;
+        }
+      else if (Option (argv[i], "--output", value))
+        {
+          outputFile = value;
+        }
+      else if (Option (argv[i], "--threshold", value))
+        {
+          threshold = atof (value.c_str ());
+        }
+      else if (Option (argv[i], "--repeats", value))
+        {
+          repeats = std::max (1, atoi (value.c_str ()));
+        }
+      else if (Option (argv[i], "--only", value))
+        {
+          only = "," + value + ",";
+        }
+      else
+        {
+          std::cerr << "usage: perf-suite [--command=<template>] [--baseline=<json>] [--output=<json>]"
+                    << " [--threshold=<fraction>] [--repeats=<n>] [--only=<scenario,...>]" << std::endl;
+          return 2;
+        }
+    }
+
+  std::map<std::string, BenchResult> baseline;
+  if (!baselineFile.empty ())
+    {
+      bool ok;
+      baseline = ReadResults (baselineFile, ok);
+      if (!ok)
+        {
+          std::cerr << "perf-suite: cannot read baseline " << baselineFile << std::endl;
+          return 2;
+        }
+    }
+
+  std::vector<BenchCase> cases = SuiteCases ();
+  std::vector<BenchResult> results;
+  uint32_t failed = 0, regressions = 0;
+  for (uint32_t c = 0; c < cases.size (); c++)
+    {
+      const BenchCase &bench = cases[c];
+      if (!only.empty () && only.find ("," + bench.scenario + ",") == std::string::npos)
+        {
+          continue;
+        }
+      std::string run = Replace (Replace (command, "{scenario}", bench.scenario),
+                                 "{args}", bench.args + " --instrument");
+      std::vector<double> wall, rate, events, rss;
+      for (uint32_t r = 0; r < repeats; r++)
+        {
+          std::map<std::string, double> record;
+          if (RunOnce (run, record))
+            {
+              wall.push_back (record["total(s)"]);
+              rate.push_back (record["eventsPerWallSecond"]);
+              events.push_back (record["events"]);
+              rss.push_back (record["peakRss"]);
+            }
+        }
+      if (wall.empty ())
+        {
+          failed++;
+          std::cerr << "perf-suite: FAILED " << bench.name << " (" << run << ")" << std::endl;
+          continue;
+        }
+      BenchResult result;
+      result.name = bench.name;
+      result.scenario = bench.scenario;
+      result.args = bench.args;
+      result.runs = wall.size ();
+      result.wall = Median (wall);
+      result.eventsPerSecond = Median (rate);
+      result.events = Median (events);
+      result.peakRss = Median (rss);
+      results.push_back (result);
+
+      std::cout << "perfCase," << result.name;
+      std::cout << ",runs," << result.runs;
+      std::cout << ",wall(s)," << result.wall;
+      std::cout << ",eventsPerSecond," << result.eventsPerSecond;
+      std::cout << ",peakRss," << result.peakRss;
+      std::map<std::string, BenchResult>::const_iterator base = baseline.find (bench.name);
+      if (base != baseline.end ())
+        {
+          const BenchResult &b = base->second;
+          double wallRatio = b.wall > 0 ? result.wall / b.wall : 1;
+          double rateRatio = result.eventsPerSecond > 0 ? b.eventsPerSecond / result.eventsPerSecond : 1;
+          double rssRatio = b.peakRss > 0 ? result.peakRss / b.peakRss : 1;
+          bool regressed = wallRatio > 1 + threshold || rateRatio > 1 + threshold || rssRatio > 1 + threshold;
+          std::cout << ",wallVsBaseline," << wallRatio;
+          std::cout << ",eventsPerSecondVsBaseline," << (b.eventsPerSecond > 0 ? result.eventsPerSecond / b.eventsPerSecond : 1);
+          std::cout << ",peakRssVsBaseline," << rssRatio;
+          std::cout << ",verdict," << (regressed ? "REGRESSION" : "ok");
+          if (regressed)
+            {
+              regressions++;
+            }
+        }
+      else if (!baselineFile.empty ())
+        {
+          std::cout << ",verdict,new";
+        }
+      std::cout << std::endl;
+    }
+
+  WriteResults (outputFile, results, threshold);
+  std::cout << "perfSuite,cases," << results.size () + failed;
+  std::cout << ",failed," << failed;
+  std::cout << ",regressions," << regressions;
+  std::cout << ",threshold," << threshold;
+  std::cout << ",output," << outputFile;
+  std::cout << std::endl;
+  return failed > 0 || regressions > 0 ? 1 : 0;
+}
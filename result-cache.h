@@ -0,0 +1,423 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Content-addressed cache of scenario results.
+//
+// A run is identified by the scenario name, its command line, every
+// attribute default and global value as resolved at lookup time (so all
+// Config::SetDefault calls, the seed and the run number are included) and
+// the identity of the build: size and modification time of the executable
+// and of every ns-3 library mapped into it. On a hit the stdout the run
+// produced is replayed and the simulation is skipped.
+//
+// Files the run writes have to be named with AddOutputFile; they are stored
+// with the entry and written back on a hit. Runs whose output cannot be
+// replayed (reports on stderr that time the run itself, traces spread over
+// many files) call Bypass instead and are neither looked up nor stored.
+//
+// The cache is off unless SCENARIO_CACHE_DIR names a directory.
+// SCENARIO_CACHE_MAX_MB (default 1024, fractions allowed) bounds its size;
+// the least recently used entries are evicted first. Entries are written to
+// a private file and renamed into place, so concurrent writers and readers
+// only ever see complete entries. Each lookup logs "resultCache,hit|miss,<key>" to stderr.
+//
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "ns3/core-module.h"
+
+// Copies everything written to one stream into a string as well
+class TeeStreamBuf : public std::streambuf
+{
+public:
+  explicit TeeStreamBuf (std::streambuf *target)
+    : m_target (target)
+  {
+  }
+
+  const std::string &GetCaptured (void) const
+  {
+    return m_captured;
+  }
+
+protected:
+  virtual int overflow (int c)
+  {
+    if (c != EOF)
+      {
+        m_captured.push_back ((char) c);
+        return m_target->sputc ((char) c);
+      }
+    return c;
+  }
+
+  virtual std::streamsize xsputn (const char *s, std::streamsize n)
+  {
+    m_captured.append (s, n);
+    return m_target->sputn (s, n);
+  }
+
+  virtual int sync (void)
+  {
+    return m_target->pubsync ();
+  }
+
+private:
+  std::streambuf *m_target;
+  std::string m_captured;
+};
+
+class ResultCache
+{
+public:
+  // Call once the scenario has applied its configuration, before it prints results
+  ResultCache (const std::string &scenario, int argc, char *argv[])
+    : m_enabled (false),
+      m_tee (0),
+      m_saved (0)
+  {
+    const char *dir = getenv ("SCENARIO_CACHE_DIR");
+    if (!dir || !*dir)
+      {
+        return;
+      }
+    m_enabled = true;
+    m_dir = dir;
+    mkdir (m_dir.c_str (), 0777);
+
+    std::ostringstream desc;
+    desc << "scenario " << scenario << "\n";
+    desc << "build " << BuildIdentity () << "\n";
+    // Flag order does not change the run
+    std::vector<std::string> args (argv + 1, argv + argc);
+    std::sort (args.begin (), args.end ());
+    for (uint32_t i = 0; i < args.size (); i++)
+      {
+        desc << "arg " << args[i] << "\n";
+      }
+    for (ns3::GlobalValue::Iterator it = ns3::GlobalValue::Begin (); it != ns3::GlobalValue::End (); ++it)
+      {
+        // The instrumented simulator (telemetry, --instrument) runs the same events
+        if ((*it)->GetName () == "SimulatorImplementationType")
+          {
+            continue;
+          }
+        ns3::StringValue value;
+        (*it)->GetValue (value);
+        desc << "global " << (*it)->GetName () << "=" << value.Get () << "\n";
+      }
+    for (uint32_t i = 0; i < ns3::TypeId::GetRegisteredN (); i++)
+      {
+        ns3::TypeId tid = ns3::TypeId::GetRegistered (i);
+        for (uint32_t j = 0; j < tid.GetAttributeN (); j++)
+          {
+            ns3::TypeId::AttributeInformation info = tid.GetAttribute (j);
+            desc << "attr " << tid.GetName () << "::" << info.name << "="
+                 << info.initialValue->SerializeToString (info.checker) << "\n";
+          }
+      }
+    m_description = desc.str ();
+    UpdateKey ();
+  }
+
+  ~ResultCache ()
+  {
+    StopCapture ();
+  }
+
+  const std::string &GetKey (void) const
+  {
+    return m_key;
+  }
+
+  // A file the run writes, kept with the entry; call before Replay ()
+  void AddOutputFile (const std::string &path)
+  {
+    if (!m_enabled)
+      {
+        return;
+      }
+    m_outputs.push_back (path);
+    m_description += "output " + path + "\n";
+    UpdateKey ();
+  }
+
+  // Run without the cache, e.g. when the run reports more than its stdout
+  void Bypass (const std::string &reason)
+  {
+    if (!m_enabled)
+      {
+        return;
+      }
+    std::cerr << "resultCache,bypass," << reason << std::endl;
+    m_enabled = false;
+  }
+
+  /**
+   * On a hit print the stored output and return true. On a miss start
+   * capturing stdout for Store () and return false.
+   */
+  bool Replay (void)
+  {
+    if (!m_enabled)
+      {
+        return false;
+      }
+    std::ifstream in (EntryPath ().c_str ());
+    std::string stored ((std::istreambuf_iterator<char> (in)), std::istreambuf_iterator<char> ());
+    // The full description is stored too, so a hash collision is a miss
+    size_t output = m_description.size () + 4;
+    if (in && stored.compare (0, m_description.size (), m_description) == 0
+        && stored.compare (m_description.size (), 4, "---\n") == 0
+        && RestoreFiles (stored, output))
+      {
+        std::cerr << "resultCache,hit," << m_key << std::endl;
+        std::cout << stored.substr (output);
+        std::cout.flush ();
+        utime (EntryPath ().c_str (), 0);  // most recently used
+        return true;
+      }
+    std::cerr << "resultCache,miss," << m_key << std::endl;
+    std::cout.flush ();
+    m_tee = new TeeStreamBuf (std::cout.rdbuf ());
+    m_saved = std::cout.rdbuf (m_tee);
+    return false;
+  }
+
+  // Save what the run printed since Replay () missed
+  void Store (void)
+  {
+    if (!m_tee)
+      {
+        return;
+      }
+    std::cout.flush ();
+    std::string output = m_tee->GetCaptured ();
+    StopCapture ();
+
+    // Each output file as "file <bytes>\n<bytes>", in AddOutputFile order
+    std::string files;
+    for (uint32_t i = 0; i < m_outputs.size (); i++)
+      {
+        std::ifstream file (m_outputs[i].c_str (), std::ios::binary);
+        if (!file)
+          {
+            return;  // not written after all, nothing to restore it from
+          }
+        std::string content ((std::istreambuf_iterator<char> (file)), std::istreambuf_iterator<char> ());
+        std::ostringstream header;
+        header << "file " << content.size () << "\n";
+        files += header.str () + content;
+      }
+
+    std::ostringstream tmp;
+    tmp << m_dir << "/.tmp." << getpid () << "." << m_key;
+    {
+      std::ofstream out (tmp.str ().c_str (), std::ios::binary);
+      out << m_description << "---\n" << files << output;
+      if (!out)
+        {
+          std::remove (tmp.str ().c_str ());
+          return;
+        }
+    }
+    if (rename (tmp.str ().c_str (), EntryPath ().c_str ()) != 0)
+      {
+        std::remove (tmp.str ().c_str ());
+        return;
+      }
+    Evict ();
+  }
+
+private:
+  static uint64_t Fnv1a (const std::string &data, uint64_t hash)
+  {
+    for (uint32_t i = 0; i < data.size (); i++)
+      {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+      }
+    return hash;
+  }
+
+  static std::string FileIdentity (const std::string &path)
+  {
+    struct stat st;
+    std::ostringstream id;
+    if (stat (path.c_str (), &st) == 0)
+      {
+        id << path << ":" << st.st_size << ":" << st.st_mtime;
+      }
+    return id.str ();
+  }
+
+  // The executable and every ns-3 library it has mapped
+  static std::string BuildIdentity (void)
+  {
+    char exe[4096];
+    ssize_t n = readlink ("/proc/self/exe", exe, sizeof (exe) - 1);
+    std::string id = n > 0 ? FileIdentity (std::string (exe, n)) : "unknown";
+    std::set<std::string> libs;
+    std::ifstream maps ("/proc/self/maps");
+    std::string line;
+    while (std::getline (maps, line))
+      {
+        size_t slash = line.find ('/');
+        if (slash != std::string::npos && line.find ("libns3", slash) != std::string::npos)
+          {
+            libs.insert (line.substr (slash));
+          }
+      }
+    for (std::set<std::string>::const_iterator it = libs.begin (); it != libs.end (); ++it)
+      {
+        id += " " + FileIdentity (*it);
+      }
+    return id;
+  }
+
+  std::string EntryPath (void) const
+  {
+    return m_dir + "/" + m_key;
+  }
+
+  void UpdateKey (void)
+  {
+    std::ostringstream key;
+    key << std::hex;
+    key.width (16);
+    key.fill ('0');
+    key << Fnv1a (m_description, 14695981039346656037ULL);
+    key.width (16);
+    key << Fnv1a (m_description, 0x84222325cbf29ce4ULL);
+    m_key = key.str ();
+  }
+
+  // Write back the stored output files from pos on; pos is left at the stdout
+  bool RestoreFiles (const std::string &stored, size_t &pos) const
+  {
+    std::vector<std::pair<size_t, size_t> > spans;
+    for (uint32_t i = 0; i < m_outputs.size (); i++)
+      {
+        size_t eol = stored.find ('\n', pos);
+        if (stored.compare (pos, 5, "file ") != 0 || eol == std::string::npos)
+          {
+            return false;
+          }
+        size_t size = strtoul (stored.c_str () + pos + 5, 0, 10);
+        if (size > stored.size () - eol - 1)
+          {
+            return false;
+          }
+        spans.push_back (std::make_pair (eol + 1, size));
+        pos = eol + 1 + size;
+      }
+    for (uint32_t i = 0; i < spans.size (); i++)
+      {
+        std::ofstream out (m_outputs[i].c_str (), std::ios::binary);
+        out.write (stored.data () + spans[i].first, spans[i].second);
+        if (!out)
+          {
+            return false;
+          }
+      }
+    return true;
+  }
+
+  void StopCapture (void)
+  {
+    if (m_tee)
+      {
+        std::cout.rdbuf (m_saved);
+        delete m_tee;
+        m_tee = 0;
+      }
+  }
+
+  // Drop least recently used entries once the cache is over its size limit
+  void Evict (void)
+  {
+    const char *limit = getenv ("SCENARIO_CACHE_MAX_MB");
+    double mb = limit ? atof (limit) : 1024.0;
+    if (mb <= 0)
+      {
+        std::cerr << "SCENARIO_CACHE_MAX_MB=" << limit << " is not a positive size, cache not evicted" << std::endl;
+        return;
+      }
+    uint64_t maxBytes = (uint64_t) (mb * 1024 * 1024);
+    // One evictor at a time; the others just skip
+    int lock = open ((m_dir + "/.lock").c_str (), O_CREAT | O_RDWR, 0666);
+    if (lock < 0)
+      {
+        return;
+      }
+    if (flock (lock, LOCK_EX | LOCK_NB) != 0)
+      {
+        close (lock);
+        return;
+      }
+    std::vector<std::pair<time_t, std::pair<uint64_t, std::string> > > entries;
+    uint64_t total = 0;
+    DIR *d = opendir (m_dir.c_str ());
+    if (d)
+      {
+        struct dirent *e;
+        while ((e = readdir (d)) != 0)
+          {
+            if (e->d_name[0] == '.')
+              {
+                continue;
+              }
+            std::string path = m_dir + "/" + e->d_name;
+            struct stat st;
+            if (stat (path.c_str (), &st) == 0 && S_ISREG (st.st_mode))
+              {
+                entries.push_back (std::make_pair (st.st_mtime, std::make_pair ((uint64_t) st.st_size, path)));
+                total += st.st_size;
+              }
+          }
+        closedir (d);
+      }
+    if (total > maxBytes)
+      {
+        // Oldest first, down to 90% of the limit
+        std::sort (entries.begin (), entries.end ());
+        for (uint32_t i = 0; i < entries.size () && total > maxBytes / 10 * 9; i++)
+          {
+            if (std::remove (entries[i].second.second.c_str ()) == 0)
+              {
+                total -= entries[i].second.first;
+              }
+          }
+      }
+    flock (lock, LOCK_UN);
+    close (lock);
+  }
+
+  bool m_enabled;
+  std::string m_dir;
+  std::string m_description;
+  std::vector<std::string> m_outputs;
+  std::string m_key;
+  TeeStreamBuf *m_tee;
+  std::streambuf *m_saved;
+};
+
+#endif /* RESULT_CACHE_H */
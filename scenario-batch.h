@@ -0,0 +1,162 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// In-process batch mode for the scenario programs.
+//
+// With --batch=<file> (or --batch=- for stdin) a scenario runs one parameter
+// point per input line, each line holding the flags a separate run would
+// get on its command line ("--queue=RED --MinTh=5"). Blank lines and lines
+// starting with '#' are skipped. Between points the simulator is destroyed,
+// attribute defaults and globals go back to their initial values and the
+// automatic RNG stream numbering and IPv4 address generator start over, so
+// every point sees the state a fresh process would.
+//
+// The point function is the scenario's former main (): it sets its seed,
+// parses its flags and prints its results as before.
+//
+
+#ifndef SCENARIO_BATCH_H
+#define SCENARIO_BATCH_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+
+#include "ns3/core-module.h"
+#include "ns3/ipv4-address-generator.h"
+
+typedef int (*ScenarioPoint) (int argc, char *argv[]);
+
+// Value of --batch=..., empty when the program was not asked to batch
+static inline std::string
+FindBatchArgument (int argc, char *argv[])
+{
+  for (int i = 1; i < argc; i++)
+    {
+      if (std::strncmp (argv[i], "--batch=", 8) == 0)
+        {
+          return argv[i] + 8;
+        }
+    }
+  return "";
+}
+
+static inline double
+BatchNow (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Seconds from process creation to now, from /proc (clock tick resolution)
+static inline double
+ProcessAgeSeconds (void)
+{
+  std::ifstream stat ("/proc/self/stat");
+  std::string field;
+  // starttime is field 22; the command name (field 2) has no spaces here
+  for (int i = 1; i < 22 && stat >> field; i++)
+    {
+    }
+  unsigned long long startTicks = 0;
+  stat >> startTicks;
+  std::ifstream uptime ("/proc/uptime");
+  double up = 0;
+  uptime >> up;
+  if (startTicks == 0 || up == 0)
+    {
+      return 0;
+    }
+  return up - (double) startTicks / sysconf (_SC_CLK_TCK);
+}
+
+// Put the process back in the state a fresh run starts from
+static inline void
+ResetBetweenPoints (void)
+{
+  ns3::Simulator::Destroy ();
+  ns3::Config::Reset ();
+  ns3::RngSeedManager::ResetNextStreamIndex ();
+  ns3::Ipv4AddressGenerator::Reset ();
+}
+
+/**
+ * Run every point listed in source through point () and report how much
+ * per-process overhead the batch saved: startup is what each separate
+ * process would pay before main (), reset what a point pays here instead.
+ */
+static inline int
+RunBatch (const std::string &source, const char *program, ScenarioPoint point)
+{
+  double startup = ProcessAgeSeconds ();
+  std::ifstream file;
+  if (source != "-")
+    {
+      file.open (source.c_str ());
+      if (!file)
+        {
+          std::cerr << "cannot open batch file " << source << std::endl;
+          return 1;
+        }
+    }
+  std::istream &in = source == "-" ? std::cin : file;
+
+  double start = BatchNow ();
+  double resetSeconds = 0;
+  uint32_t points = 0;
+  int status = 0;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      std::istringstream words (line);
+      std::vector<std::string> args;
+      std::string word;
+      while (words >> word)
+        {
+          args.push_back (word);
+        }
+      if (args.empty () || args[0][0] == '#')
+        {
+          continue;
+        }
+
+      if (points > 0)
+        {
+          double resetStart = BatchNow ();
+          ResetBetweenPoints ();
+          resetSeconds += BatchNow () - resetStart;
+        }
+      std::vector<char *> argv;
+      argv.push_back (const_cast<char *> (program));
+      for (uint32_t i = 0; i < args.size (); i++)
+        {
+          argv.push_back (&args[i][0]);
+        }
+      argv.push_back (0);
+      if (point (argv.size () - 1, &argv[0]) != 0)
+        {
+          status = 1;
+        }
+      std::cout.flush ();
+      points++;
+    }
+
+  double wall = BatchNow () - start;
+  std::cerr << "batch,points," << points;
+  std::cerr << ",wall(s)," << wall;
+  std::cerr << ",startup(s)," << startup;
+  std::cerr << ",reset(s)," << resetSeconds;
+  if (points > 1)
+    {
+      std::cerr << ",savedPerPoint(s)," << startup - resetSeconds / (points - 1);
+    }
+  std::cerr << std::endl;
+  return status;
+}
+
+#endif /* SCENARIO_BATCH_H */
@@ -0,0 +1,526 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Run instrumentation shared by the scenario programs: wall time of each
+// phase (the SetupProfile marks) plus the event load of Simulator::Run,
+// printed as one "runProfile" record per run on stderr.
+//
+// Events are counted by an instrumented simulator implementation that
+// wraps every scheduled event, so EnableEventCounting () has to be called
+// before anything is scheduled (after CommandLine::Parse is fine). The
+// wrapper costs one small allocation per event; compare event rates only
+// between instrumented runs. Pending events are the ones scheduled and
+// neither executed, cancelled nor removed; cancelled events still sitting
+// in the queue are not counted. Destroy events are not counted at all.
+//
+// The record goes to stderr so cached results (result-cache.h) never
+// replay a stale one; sweep-runner collects it into <output>/profile.csv.
+//
+// EnableEventProfile () additionally times every event by callback type:
+// calls, total and p99 wall time and, in builds with the operator new
+// hooks of scenario-profile.h, heap allocations. The type is the bound function's type as
+// MakeEvent saw it, e.g. "void (ns3::DcaTxop::*)()", so handlers of one
+// class with the same signature share a row, and every ns3::Timer expiry
+// shows as Timer::Expire. PrintEventProfile () ranks them by total time
+// and writes folded stacks ("scheduler;callback microseconds", the input
+// of flamegraph.pl) where the parent frame is the callback that
+// scheduled the event, or "setup" for events scheduled before the run.
+//
+
+#ifndef SCENARIO_INSTRUMENT_H
+#define SCENARIO_INSTRUMENT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <typeinfo>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "ns3/core-module.h"
+#include "ns3/default-simulator-impl.h"
+
+#include "scenario-profile.h"
+
+// Event totals of the running simulator
+struct EventCounts
+{
+  uint64_t executed;
+  uint64_t scheduled;
+  uint64_t peakPending;  // most events waiting in the queue at once
+};
+
+// Wall time and allocations of every event run through one callback type
+struct CallbackStats
+{
+  // Run times in quarter-octave buckets: 4 per power of two nanoseconds
+  enum { BUCKETS = 256 };
+
+  CallbackStats ()
+    : calls (0),
+      nanoseconds (0),
+      allocations (0),
+      histogram (BUCKETS, 0)
+  {
+  }
+
+  void Add (uint64_t ns, uint64_t allocs)
+  {
+    calls++;
+    nanoseconds += ns;
+    allocations += allocs;
+    histogram[Bucket (ns)]++;
+  }
+
+  // Upper edge of the bucket holding the p-quantile, within 19% of the exact value
+  uint64_t Quantile (double p) const
+  {
+    uint64_t rank = (uint64_t) (p * calls);
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < BUCKETS; b++)
+      {
+        seen += histogram[b];
+        if (seen > rank)
+          {
+            uint32_t octave = b / 4;
+            return octave < 2 ? octave + 1 : (uint64_t) (4 + b % 4 + 1) << (octave - 2);
+          }
+      }
+    return 0;
+  }
+
+  static uint32_t Bucket (uint64_t ns)
+  {
+    if (ns < 2)
+      {
+        return 0;
+      }
+    uint32_t octave = 63 - __builtin_clzll (ns);
+    return octave * 4 + (octave < 2 ? 0 : (ns >> (octave - 2)) & 3);
+  }
+
+  std::string name;
+  uint64_t calls;
+  uint64_t nanoseconds;
+  uint64_t allocations;
+  std::vector<uint64_t> histogram;
+};
+
+class InstrumentedSimulatorImpl : public ns3::DefaultSimulatorImpl
+{
+public:
+  static ns3::TypeId GetTypeId (void)
+  {
+    static ns3::TypeId tid = ns3::TypeId ("InstrumentedSimulatorImpl")
+      .SetParent<ns3::DefaultSimulatorImpl> ()
+      .AddConstructor<InstrumentedSimulatorImpl> ()
+      .AddAttribute ("Profile", "Time every event by callback type",
+                     ns3::BooleanValue (false),
+                     ns3::MakeBooleanAccessor (&InstrumentedSimulatorImpl::m_profile),
+                     ns3::MakeBooleanChecker ());
+    return tid;
+  }
+
+  InstrumentedSimulatorImpl ()
+    : m_pending (0),
+      m_profile (false),
+      m_current (0)
+  {
+    m_counts.executed = 0;
+    m_counts.scheduled = 0;
+    m_counts.peakPending = 0;
+  }
+
+  virtual ~InstrumentedSimulatorImpl ()
+  {
+    for (std::map<std::string, CallbackStats *>::iterator it = m_byName.begin (); it != m_byName.end (); ++it)
+      {
+        delete it->second;
+      }
+  }
+
+  virtual ns3::EventId Schedule (ns3::Time const &time, ns3::EventImpl *event)
+  {
+    return ns3::DefaultSimulatorImpl::Schedule (time, Wrap (event));
+  }
+
+  virtual void ScheduleWithContext (uint32_t context, ns3::Time const &time, ns3::EventImpl *event)
+  {
+    ns3::DefaultSimulatorImpl::ScheduleWithContext (context, time, Wrap (event));
+  }
+
+  virtual ns3::EventId ScheduleNow (ns3::EventImpl *event)
+  {
+    return ns3::DefaultSimulatorImpl::ScheduleNow (Wrap (event));
+  }
+
+  virtual void Remove (const ns3::EventId &id)
+  {
+    Forget (id);
+    ns3::DefaultSimulatorImpl::Remove (id);
+  }
+
+  virtual void Cancel (const ns3::EventId &id)
+  {
+    Forget (id);
+    ns3::DefaultSimulatorImpl::Cancel (id);
+  }
+
+  const EventCounts &GetCounts (void) const
+  {
+    return m_counts;
+  }
+
+  // Callback types that ran, most total wall time first
+  std::vector<const CallbackStats *> GetProfile (void) const
+  {
+    std::vector<const CallbackStats *> ranked;
+    for (std::map<std::string, CallbackStats *>::const_iterator it = m_byName.begin (); it != m_byName.end (); ++it)
+      {
+        if (it->second->calls > 0)
+          {
+            ranked.push_back (it->second);
+          }
+      }
+    std::sort (ranked.begin (), ranked.end (), ByTotalTime);
+    return ranked;
+  }
+
+  // Nanoseconds per (scheduling callback, callback); a null scheduler is setup
+  const std::map<std::pair<CallbackStats *, CallbackStats *>, uint64_t> &GetEdges (void) const
+  {
+    return m_edges;
+  }
+
+private:
+  typedef std::map<std::pair<CallbackStats *, CallbackStats *>, uint64_t> EdgeMap;
+
+  // Counts the event when it runs, then runs the scheduled one
+  class CountingEvent : public ns3::EventImpl
+  {
+  public:
+    CountingEvent (ns3::EventImpl *event, InstrumentedSimulatorImpl *sim, CallbackStats *stats, uint64_t *edge)
+      : m_event (event, false),
+        m_sim (sim),
+        m_stats (stats),
+        m_edge (edge)
+    {
+    }
+
+  protected:
+    virtual void Notify (void)
+    {
+      m_sim->m_counts.executed++;
+      m_sim->m_pending--;
+      if (!m_stats)
+        {
+          m_event->Invoke ();
+          return;
+        }
+      // Events never nest, so this is the callback's own time
+      CallbackStats *outer = m_sim->m_current;
+      m_sim->m_current = m_stats;
+      uint64_t allocs = g_allocationCounters.allocations;
+      uint64_t scheduled = m_sim->m_counts.scheduled;
+      uint64_t start = Nanoseconds ();
+      m_event->Invoke ();
+      uint64_t ns = Nanoseconds () - start;
+      // Not counting the wrappers of the events it scheduled
+      allocs = g_allocationCounters.allocations - allocs - (m_sim->m_counts.scheduled - scheduled);
+      m_stats->Add (ns, allocs);
+      *m_edge += ns;
+      m_sim->m_current = outer;
+    }
+
+  private:
+    ns3::Ptr<ns3::EventImpl> m_event;
+    InstrumentedSimulatorImpl *m_sim;
+    CallbackStats *m_stats;
+    uint64_t *m_edge;
+  };
+
+  ns3::EventImpl *Wrap (ns3::EventImpl *event)
+  {
+    m_counts.scheduled++;
+    if (++m_pending > m_counts.peakPending)
+      {
+        m_counts.peakPending = m_pending;
+      }
+    if (!m_profile)
+      {
+        return new CountingEvent (event, this, 0, 0);
+      }
+    CallbackStats *stats = Lookup (typeid (*event));
+    uint64_t *edge = &m_edges[std::make_pair (m_current, stats)];
+    return new CountingEvent (event, this, stats, edge);
+  }
+
+  CallbackStats *Lookup (const std::type_info &type)
+  {
+    // Names are compared by pointer first; one type may have several copies
+    std::map<const char *, CallbackStats *>::iterator seen = m_byType.find (type.name ());
+    if (seen != m_byType.end ())
+      {
+        return seen->second;
+      }
+    std::string name = CallbackName (type);
+    CallbackStats *&stats = m_byName[name];
+    if (!stats)
+      {
+        stats = new CallbackStats;
+        stats->name = name;
+      }
+    m_byType[type.name ()] = stats;
+    return stats;
+  }
+
+  // MakeEvent<void (ns3::Foo::*)(int), ns3::Foo *, int>(...)::EventMemberImpl1 -> void (ns3::Foo::*)(int)
+  static std::string CallbackName (const std::type_info &type)
+  {
+    int status = 0;
+    char *demangled = abi::__cxa_demangle (type.name (), 0, 0, &status);
+    std::string name = status == 0 && demangled ? demangled : type.name ();
+    std::free (demangled);
+    size_t start = name.find ("MakeEvent<");
+    if (start == std::string::npos)
+      {
+        return name;
+      }
+    start += 10;
+    int depth = 0;
+    for (size_t i = start; i < name.size (); i++)
+      {
+        char c = name[i];
+        if (c == '<' || c == '(')
+          {
+            depth++;
+          }
+        else if ((c == '>' || c == ')') && depth > 0)
+          {
+            depth--;
+          }
+        else if ((c == ',' || c == '>') && depth == 0)
+          {
+            return name.substr (start, i - start);
+          }
+      }
+    return name;
+  }
+
+  static bool ByTotalTime (const CallbackStats *a, const CallbackStats *b)
+  {
+    return a->nanoseconds > b->nanoseconds;
+  }
+
+  static uint64_t Nanoseconds (void)
+  {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+  // A pending event leaves the queue without running
+  void Forget (const ns3::EventId &id)
+  {
+    if (!IsExpired (id) && dynamic_cast<CountingEvent *> (id.PeekEventImpl ()))
+      {
+        m_pending--;
+      }
+  }
+
+  EventCounts m_counts;
+  uint64_t m_pending;
+  bool m_profile;
+  CallbackStats *m_current;  // callback running now, 0 outside events
+  std::map<const char *, CallbackStats *> m_byType;
+  std::map<std::string, CallbackStats *> m_byName;
+  EdgeMap m_edges;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (InstrumentedSimulatorImpl);
+
+// Make the next simulator count its events
+static inline void
+EnableEventCounting (void)
+{
+  ns3::GlobalValue::Bind ("SimulatorImplementationType", ns3::StringValue ("InstrumentedSimulatorImpl"));
+}
+
+// Make the next simulator time its events by callback type as well
+static inline void
+EnableEventProfile (void)
+{
+  EnableEventCounting ();
+  ns3::Config::SetDefault ("InstrumentedSimulatorImpl::Profile", ns3::BooleanValue (true));
+}
+
+// Totals so far, all zero unless EnableEventCounting () took effect
+static inline EventCounts
+GetEventCounts (void)
+{
+  ns3::Ptr<InstrumentedSimulatorImpl> impl =
+    ns3::DynamicCast<InstrumentedSimulatorImpl> (ns3::Simulator::GetImplementation ());
+  if (impl)
+    {
+      return impl->GetCounts ();
+    }
+  EventCounts none = { 0, 0, 0 };
+  return none;
+}
+
+/**
+ * One line per run: wall time of every phase, then the events executed
+ * over runWall seconds of Simulator::Run, their rate and the peak queue.
+ */
+static inline void
+PrintRunRecord (std::ostream &os, const std::string &scenario, uint32_t nodes,
+                const SetupProfile &profile, const EventCounts &events, double runWall)
+{
+  const std::vector<SetupProfile::Phase> &phases = profile.GetPhases ();
+  double total = 0;
+  os << "runProfile," << scenario;
+  os << ",nodes," << nodes;
+  for (uint32_t i = 0; i < phases.size (); i++)
+    {
+      os << "," << phases[i].name << "(s)," << phases[i].wallSeconds;
+      total += phases[i].wallSeconds;
+    }
+  os << ",total(s)," << total;
+  os << ",events," << events.executed;
+  os << ",eventsPerWallSecond," << (runWall > 0 ? events.executed / runWall : 0.0);
+  os << ",peakPendingEvents," << events.peakPending;
+  os << ",peakRss," << PeakResidentBytes ();
+  os << std::endl;
+}
+
+/**
+ * Ranked table of callback types on os ("eventProfile" lines) and folded
+ * stacks for a flame graph in foldedFile. Call before Simulator::Destroy.
+ */
+static inline void
+PrintEventProfile (std::ostream &os, const std::string &scenario, const std::string &foldedFile)
+{
+  ns3::Ptr<InstrumentedSimulatorImpl> impl =
+    ns3::DynamicCast<InstrumentedSimulatorImpl> (ns3::Simulator::GetImplementation ());
+  if (!impl)
+    {
+      return;
+    }
+  std::vector<const CallbackStats *> ranked = impl->GetProfile ();
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < ranked.size (); i++)
+    {
+      total += ranked[i]->nanoseconds;
+    }
+  for (uint32_t i = 0; i < ranked.size (); i++)
+    {
+      const CallbackStats &s = *ranked[i];
+      os << "eventProfile," << scenario;
+      os << ",rank," << i + 1;
+      os << ",calls," << s.calls;
+      os << ",total(s)," << s.nanoseconds * 1e-9;
+      os << ",share," << (total > 0 ? (double) s.nanoseconds / total : 0.0);
+      os << ",mean(us)," << s.nanoseconds * 1e-3 / s.calls;
+      os << ",p99(us)," << s.Quantile (0.99) * 1e-3;
+      if (g_allocationHooks)
+        {
+          os << ",allocs," << s.allocations;
+          os << ",allocsPerCall," << (double) s.allocations / s.calls;
+        }
+      // Last: the type names hold commas
+      os << ",callback," << s.name;
+      os << std::endl;
+    }
+
+  std::ofstream folded (foldedFile.c_str ());
+  const std::map<std::pair<CallbackStats *, CallbackStats *>, uint64_t> &edges = impl->GetEdges ();
+  for (std::map<std::pair<CallbackStats *, CallbackStats *>, uint64_t>::const_iterator it = edges.begin ();
+       it != edges.end (); ++it)
+    {
+      if (it->second / 1000 == 0)
+        {
+          continue;
+        }
+      folded << scenario << ";" << (it->first.first ? it->first.first->name : "setup")
+             << ";" << it->first.second->name << " " << it->second / 1000 << "\n";
+    }
+}
+
+/**
+ * Phase marks and the record for a scenario written as one straight-line
+ * function (p1, p2, Ip2): construct it right after parsing the command
+ * line, Mark () each phase, and use Run () and Destroy () in place of the
+ * Simulator calls. Does nothing unless enabled; a non-empty eventProfile
+ * also profiles callbacks and names the folded-stack file.
+ */
+class RunInstrument
+{
+public:
+  RunInstrument (const std::string &scenario, bool enabled, const std::string &eventProfile = "")
+    : m_scenario (scenario),
+      m_enabled (enabled),
+      m_eventProfile (eventProfile),
+      m_runWall (0)
+  {
+    m_events.executed = 0;
+    m_events.scheduled = 0;
+    m_events.peakPending = 0;
+    if (!m_eventProfile.empty ())
+      {
+        EnableEventProfile ();
+      }
+    else if (m_enabled)
+      {
+        EnableEventCounting ();
+      }
+  }
+
+  void Mark (const std::string &phase)
+  {
+    if (m_enabled)
+      {
+        m_profile.Mark (phase);
+      }
+  }
+
+  void Run (void)
+  {
+    double start = SetupProfile::Now ();
+    ns3::Simulator::Run ();
+    m_runWall = SetupProfile::Now () - start;
+    if (m_enabled)
+      {
+        m_events = GetEventCounts ();
+        m_profile.Mark ("run");
+      }
+    if (!m_eventProfile.empty ())
+      {
+        PrintEventProfile (std::cerr, m_scenario, m_eventProfile);
+      }
+  }
+
+  // Destroys the simulator and prints the record
+  void Destroy (uint32_t nodes)
+  {
+    ns3::Simulator::Destroy ();
+    if (m_enabled)
+      {
+        m_profile.Mark ("destroy");
+        PrintRunRecord (std::cerr, m_scenario, nodes, m_profile, m_events, m_runWall);
+      }
+  }
+
+private:
+  std::string m_scenario;
+  bool m_enabled;
+  std::string m_eventProfile;
+  SetupProfile m_profile;
+  EventCounts m_events;
+  double m_runWall;
+};
+
+#endif /* SCENARIO_INSTRUMENT_H */
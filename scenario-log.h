@@ -0,0 +1,165 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Scenario logging that compiles out below a chosen level.
+//
+// SCENARIO_LOG_ERROR/WARN/INFO/DEBUG (msg) take a stream expression like
+// NS_LOG_INFO and write one line to std::clog. Levels above the compile-time
+// SCENARIO_LOG_LEVEL expand to nothing, so not even the level check is left
+// on the path:
+//
+//   0 off, 1 error, 2 warn, 3 info, 4 debug
+//
+// Build with CXXFLAGS=-DSCENARIO_LOG_LEVEL=<n> to choose; by default it is
+// info when ns-3's own logging is compiled in (debug profile) and off
+// otherwise, which is what the NS_LOG calls it replaces did. ns-3's module
+// logs still follow the ns-3 build profile.
+//
+// At run time the compiled-in messages can be thinned out for long runs:
+//
+//   SCENARIO_LOG=<level>      highest level printed (default: all compiled in)
+//   SCENARIO_LOG_EVERY=<n>    print every n-th message of each call site
+//   SCENARIO_LOG_RATE=<r>     at most r messages per wall second per site
+//
+// A printed line that follows dropped ones ends in "[+k suppressed]".
+//
+
+#ifndef SCENARIO_LOG_H
+#define SCENARIO_LOG_H
+
+#include <iostream>
+#include <cstdlib>
+#include <stdint.h>
+#include <time.h>
+
+#define SCENARIO_LOG_LEVEL_OFF   0
+#define SCENARIO_LOG_LEVEL_ERROR 1
+#define SCENARIO_LOG_LEVEL_WARN  2
+#define SCENARIO_LOG_LEVEL_INFO  3
+#define SCENARIO_LOG_LEVEL_DEBUG 4
+
+#ifndef SCENARIO_LOG_LEVEL
+#ifdef NS3_LOG_ENABLE
+#define SCENARIO_LOG_LEVEL SCENARIO_LOG_LEVEL_INFO
+#else
+#define SCENARIO_LOG_LEVEL SCENARIO_LOG_LEVEL_OFF
+#endif
+#endif
+
+// Sampling state of one call site
+struct ScenarioLogSite
+{
+  ScenarioLogSite () : seen (0), suppressed (0), tokens (-1), refilled (0) {}
+  uint64_t seen;
+  uint64_t suppressed;  // since the last printed line
+  double tokens;        // rate limit bucket, -1 until first use
+  double refilled;
+};
+
+struct ScenarioLogConfig
+{
+  int level;
+  uint64_t every;
+  double rate;
+};
+
+static inline const ScenarioLogConfig &
+ScenarioLogSettings (void)
+{
+  static ScenarioLogConfig config;
+  static bool loaded = false;
+  if (!loaded)
+    {
+      const char *level = getenv ("SCENARIO_LOG");
+      const char *every = getenv ("SCENARIO_LOG_EVERY");
+      const char *rate = getenv ("SCENARIO_LOG_RATE");
+      config.level = level ? atoi (level) : SCENARIO_LOG_LEVEL;
+      config.every = every && atoi (every) > 1 ? atoi (every) : 1;
+      config.rate = rate ? atof (rate) : 0;
+      loaded = true;
+    }
+  return config;
+}
+
+// Whether this message of site is printed; counts it as suppressed if not
+static inline bool
+ScenarioLogAdmit (int level, ScenarioLogSite &site)
+{
+  const ScenarioLogConfig &config = ScenarioLogSettings ();
+  if (level > config.level)
+    {
+      return false;
+    }
+  if (site.seen++ % config.every != 0)
+    {
+      site.suppressed++;
+      return false;
+    }
+  if (config.rate > 0)
+    {
+      struct timespec ts;
+      clock_gettime (CLOCK_MONOTONIC, &ts);
+      double now = ts.tv_sec + ts.tv_nsec * 1e-9;
+      double burst = config.rate < 1 ? 1 : config.rate;
+      site.tokens = site.tokens < 0 ? burst : site.tokens + (now - site.refilled) * config.rate;
+      site.tokens = site.tokens > burst ? burst : site.tokens;
+      site.refilled = now;
+      if (site.tokens < 1)
+        {
+          site.suppressed++;
+          return false;
+        }
+      site.tokens -= 1;
+    }
+  return true;
+}
+
+static inline void
+ScenarioLogEnd (std::ostream &os, ScenarioLogSite &site)
+{
+  if (site.suppressed > 0)
+    {
+      os << " [+" << site.suppressed << " suppressed]";
+      site.suppressed = 0;
+    }
+  os << std::endl;
+}
+
+#define SCENARIO_LOG_EMIT(level, msg)                                   \
+  do                                                                    \
+    {                                                                   \
+      static ScenarioLogSite scenarioLogSite;                           \
+      if (ScenarioLogAdmit (level, scenarioLogSite))                    \
+        {                                                               \
+          std::clog << msg;                                             \
+          ScenarioLogEnd (std::clog, scenarioLogSite);                  \
+        }                                                               \
+    }                                                                   \
+  while (false)
+
+#define SCENARIO_LOG_NOTHING(msg) do { } while (false)
+
+#if SCENARIO_LOG_LEVEL >= SCENARIO_LOG_LEVEL_ERROR
+#define SCENARIO_LOG_ERROR(msg) SCENARIO_LOG_EMIT (SCENARIO_LOG_LEVEL_ERROR, msg)
+#else
+#define SCENARIO_LOG_ERROR(msg) SCENARIO_LOG_NOTHING (msg)
+#endif
+
+#if SCENARIO_LOG_LEVEL >= SCENARIO_LOG_LEVEL_WARN
+#define SCENARIO_LOG_WARN(msg) SCENARIO_LOG_EMIT (SCENARIO_LOG_LEVEL_WARN, msg)
+#else
+#define SCENARIO_LOG_WARN(msg) SCENARIO_LOG_NOTHING (msg)
+#endif
+
+#if SCENARIO_LOG_LEVEL >= SCENARIO_LOG_LEVEL_INFO
+#define SCENARIO_LOG_INFO(msg) SCENARIO_LOG_EMIT (SCENARIO_LOG_LEVEL_INFO, msg)
+#else
+#define SCENARIO_LOG_INFO(msg) SCENARIO_LOG_NOTHING (msg)
+#endif
+
+#if SCENARIO_LOG_LEVEL >= SCENARIO_LOG_LEVEL_DEBUG
+#define SCENARIO_LOG_DEBUG(msg) SCENARIO_LOG_EMIT (SCENARIO_LOG_LEVEL_DEBUG, msg)
+#else
+#define SCENARIO_LOG_DEBUG(msg) SCENARIO_LOG_NOTHING (msg)
+#endif
+
+#endif /* SCENARIO_LOG_H */
@@ -0,0 +1,200 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Setup-phase profile for the scenario programs: wall time, resident size
+// and memory growth between consecutive phase marks.
+//
+// By default that is all it measures, and memory growth is the growth of
+// the resident set. A profiling build with
+// CXXFLAGS=-DSCENARIO_PROFILE_ALLOC_HOOKS also counts allocations and live
+// heap bytes, by replacing the global operator new/delete (live bytes use
+// glibc's malloc_usable_size); memory growth is then heap growth. The
+// hooks tax every allocation of the run, so they stay out of normal builds.
+// With them this header must be included by exactly one translation unit
+// of a program (every scenario here is a single file).
+//
+
+#ifndef SCENARIO_PROFILE_H
+#define SCENARIO_PROFILE_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <malloc.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+#if __cplusplus >= 201103L
+#define SCENARIO_THROW_BAD_ALLOC
+#define SCENARIO_NOTHROW noexcept
+#else
+#define SCENARIO_THROW_BAD_ALLOC throw (std::bad_alloc)
+#define SCENARIO_NOTHROW throw ()
+#endif
+
+// Process-wide allocation counters, updated by the operator new below
+struct AllocationCounters
+{
+  uint64_t allocations;
+  uint64_t bytes;
+  uint64_t liveBytes;  // usable size of the blocks not yet deleted
+};
+
+static AllocationCounters g_allocationCounters = { 0, 0, 0 };
+
+#ifdef SCENARIO_PROFILE_ALLOC_HOOKS
+static const bool g_allocationHooks = true;
+
+void *
+operator new (std::size_t size) SCENARIO_THROW_BAD_ALLOC
+{
+  void *p = std::malloc (size ? size : 1);
+  if (!p)
+    {
+      throw std::bad_alloc ();
+    }
+  g_allocationCounters.allocations++;
+  g_allocationCounters.bytes += size;
+  g_allocationCounters.liveBytes += malloc_usable_size (p);
+  return p;
+}
+
+void
+operator delete (void *p) SCENARIO_NOTHROW
+{
+  if (p)
+    {
+      g_allocationCounters.liveBytes -= malloc_usable_size (p);
+    }
+  std::free (p);
+}
+#else
+static const bool g_allocationHooks = false;
+#endif /* SCENARIO_PROFILE_ALLOC_HOOKS */
+
+// Resident set size of this process from /proc, 0 where unavailable
+static inline uint64_t
+ResidentBytes (void)
+{
+  std::ifstream statm ("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
+// High-water resident set size of this process
+static inline uint64_t
+PeakResidentBytes (void)
+{
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return (uint64_t) usage.ru_maxrss * 1024;
+}
+
+class SetupProfile
+{
+public:
+  struct Phase
+  {
+    std::string name;
+    double wallSeconds;
+    uint64_t allocations;
+    uint64_t bytes;
+    int64_t liveBytes;  // heap growth over the phase (resident growth without
+                        // the hooks), negative if it freed more
+    uint64_t rss;       // resident size at the end of the phase
+  };
+
+  SetupProfile ()
+    : m_last (Now ()),
+      m_lastAlloc (g_allocationCounters),
+      m_lastRss (ResidentBytes ())
+  {
+  }
+
+  // Close the phase that started at the previous mark (or construction)
+  void Mark (const std::string &phase)
+  {
+    double now = Now ();
+    Phase p;
+    p.name = phase;
+    p.wallSeconds = now - m_last;
+    p.allocations = g_allocationCounters.allocations - m_lastAlloc.allocations;
+    p.bytes = g_allocationCounters.bytes - m_lastAlloc.bytes;
+    p.rss = ResidentBytes ();
+    if (g_allocationHooks)
+      {
+        p.liveBytes = (int64_t) g_allocationCounters.liveBytes - (int64_t) m_lastAlloc.liveBytes;
+      }
+    else
+      {
+        p.liveBytes = (int64_t) p.rss - (int64_t) m_lastRss;
+      }
+    m_phases.push_back (p);
+    m_last = now;
+    m_lastAlloc = g_allocationCounters;
+    m_lastRss = p.rss;
+  }
+
+  // One line per phase; per-node figures show whether setup scales linearly
+  void Print (std::ostream &os, const std::string &scenario, uint32_t nodes) const
+  {
+    for (uint32_t i = 0; i < m_phases.size (); i++)
+      {
+        const Phase &p = m_phases[i];
+        os << "setupProfile," << scenario;
+        os << ",nodes," << nodes;
+        os << ",phase," << p.name;
+        os << ",wall(s)," << p.wallSeconds;
+        if (g_allocationHooks)
+          {
+            os << ",allocs," << p.allocations;
+            os << ",allocBytes," << p.bytes;
+            os << ",heapGrowth," << p.liveBytes;
+          }
+        else
+          {
+            os << ",rssGrowth," << p.liveBytes;
+          }
+        os << ",rss," << p.rss;
+        if (nodes > 0)
+          {
+            os << ",wallPerNode(us)," << p.wallSeconds * 1e6 / nodes;
+            if (g_allocationHooks)
+              {
+                os << ",allocsPerNode," << (double) p.allocations / nodes;
+                os << ",heapGrowthPerNode," << (double) p.liveBytes / nodes;
+              }
+            else
+              {
+                os << ",rssGrowthPerNode," << (double) p.liveBytes / nodes;
+              }
+          }
+        os << std::endl;
+      }
+  }
+
+  const std::vector<Phase> &GetPhases (void) const
+  {
+    return m_phases;
+  }
+
+  static double Now (void)
+  {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+private:
+  double m_last;
+  AllocationCounters m_lastAlloc;
+  uint64_t m_lastRss;
+  std::vector<Phase> m_phases;
+};
+
+#endif /* SCENARIO_PROFILE_H */
@@ -0,0 +1,275 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Live progress of a scenario run in a status file.
+//
+// When SCENARIO_STATUS_FILE names a file, a background thread rewrites it
+// every SCENARIO_STATUS_INTERVAL seconds (default 1) with one line:
+//
+//   status,p3,state,running,pid,4242,wall(s),12.0,simTime(s),3.1,
+//   stopTime(s),10,events,812345,eventsPerWallSecond,70012,simPerWall,0.26,
+//   eta(s),26.5,rss,181403648,updated,1760000000
+//
+// Rates and the ETA to ScenarioStop are over the last interval. The file
+// is written to a private name and renamed, so readers never see a partial
+// line. Progress is sampled by one self-rescheduling simulator event: events
+// is the number of events scheduled so far, which the default simulator
+// already keeps as the id of the next event, and simTime is the time of the
+// last sample. The sample period adapts to a few samples per status line,
+// so a run stuck at one simulated instant stops advancing both. Events are
+// not wrapped, and nothing is published unless the file is requested. The
+// thread only reads the published counters and /proc, never the simulator
+// itself. It does not allocate either: the allocation counters of
+// scenario-profile.h are not atomic. Processes forked by the scenario do not
+// report: a fork keeps only the forking thread.
+//
+// sweep-runner sets the variable for the points of grids with a "stall"
+// limit and uses the file to find runs whose event count has stopped moving.
+//
+
+#ifndef SCENARIO_TELEMETRY_H
+#define SCENARIO_TELEMETRY_H
+
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "ns3/core-module.h"
+
+// Progress of the running simulator for the status thread; written and read
+// with relaxed atomics, in simulator time steps
+struct EventProgress
+{
+  uint64_t scheduled;       // events scheduled up to the last sample
+  uint64_t timeStep;        // time of the last sample
+  uint64_t stopStep;        // where ScenarioStop ends the run, 0 if not set
+  uint64_t stepsPerSecond;
+};
+
+static EventProgress g_eventProgress = { 0, 0, 0, 0 };
+
+// Simulator::Stop that also tells the status file where the run ends
+static inline void
+ScenarioStop (const ns3::Time &delay)
+{
+  __atomic_store_n (&g_eventProgress.stopStep, (uint64_t) (ns3::Simulator::Now () + delay).GetTimeStep (),
+                    __ATOMIC_RELAXED);
+  ns3::Simulator::Stop (delay);
+}
+
+class StatusTelemetry
+{
+public:
+  // Starts the thread if SCENARIO_STATUS_FILE is set; call before scheduling anything
+  explicit StatusTelemetry (const std::string &scenario)
+    : m_scenario (scenario),
+      m_interval (1.0),
+      m_running (false),
+      m_stop (false)
+  {
+    const char *path = getenv ("SCENARIO_STATUS_FILE");
+    if (!path || !*path)
+      {
+        return;
+      }
+    const char *interval = getenv ("SCENARIO_STATUS_INTERVAL");
+    if (interval && atof (interval) > 0)
+      {
+        m_interval = atof (interval);
+      }
+    m_path = path;
+    m_tmpPath = m_path + ".tmp";
+    uint64_t perSecond = (uint64_t) (1.0 / ns3::TimeStep (1).GetSeconds () + 0.5);
+    __atomic_store_n (&g_eventProgress.scheduled, 0, __ATOMIC_RELAXED);
+    __atomic_store_n (&g_eventProgress.timeStep, 0, __ATOMIC_RELAXED);
+    __atomic_store_n (&g_eventProgress.stopStep, 0, __ATOMIC_RELAXED);
+    __atomic_store_n (&g_eventProgress.stepsPerSecond, perSecond, __ATOMIC_RELAXED);
+    m_sampleSteps = std::max<uint64_t> (perSecond / 1000, 1);  // 1 ms to start with
+    m_maxSampleSteps = perSecond;
+    m_minSampleSteps = std::max<uint64_t> (perSecond / 1000000, 1);
+    m_lastSample = Now ();
+    ns3::Simulator::Schedule (ns3::Seconds (0), &StatusTelemetry::Sample, this);
+    pthread_mutex_init (&m_mutex, 0);
+    pthread_cond_init (&m_wake, 0);
+    m_start = Now ();
+    m_lastWall = m_start;
+    m_lastEvents = 0;
+    m_lastStep = 0;
+    m_running = pthread_create (&m_thread, 0, &StatusTelemetry::Loop, this) == 0;
+  }
+
+  // Stops the thread and leaves a final "done" line
+  ~StatusTelemetry ()
+  {
+    if (!m_running)
+      {
+        return;
+      }
+    pthread_mutex_lock (&m_mutex);
+    m_stop = true;
+    pthread_cond_signal (&m_wake);
+    pthread_mutex_unlock (&m_mutex);
+    pthread_join (m_thread, 0);
+    Write ("done");
+    pthread_cond_destroy (&m_wake);
+    pthread_mutex_destroy (&m_mutex);
+  }
+
+private:
+  // A simulator event; the default implementation numbers every scheduled
+  // event, so the id of the next sample is the count so far
+  void Sample (void)
+  {
+    double wall = Now ();
+    if (wall - m_lastSample < m_interval / 8)
+      {
+        m_sampleSteps = std::min (m_sampleSteps * 2, m_maxSampleSteps);
+      }
+    else if (wall - m_lastSample > m_interval / 2)
+      {
+        m_sampleSteps = std::max (m_sampleSteps / 2, m_minSampleSteps);
+      }
+    m_lastSample = wall;
+    __atomic_store_n (&g_eventProgress.timeStep, (uint64_t) ns3::Simulator::Now ().GetTimeStep (), __ATOMIC_RELAXED);
+    // Never the only event left: that would keep a run without a stop going
+    if (!ns3::Simulator::IsFinished ())
+      {
+        ns3::EventId next = ns3::Simulator::Schedule (ns3::TimeStep (m_sampleSteps), &StatusTelemetry::Sample, this);
+        __atomic_store_n (&g_eventProgress.scheduled, next.GetUid (), __ATOMIC_RELAXED);
+      }
+  }
+
+  static void *Loop (void *self)
+  {
+    StatusTelemetry *t = static_cast<StatusTelemetry *> (self);
+    t->Write ("running");
+    pthread_mutex_lock (&t->m_mutex);
+    while (!t->m_stop)
+      {
+        struct timeval now;
+        gettimeofday (&now, 0);
+        double due = now.tv_sec + now.tv_usec * 1e-6 + t->m_interval;
+        struct timespec until;
+        until.tv_sec = (time_t) due;
+        until.tv_nsec = (long) ((due - until.tv_sec) * 1e9);
+        if (pthread_cond_timedwait (&t->m_wake, &t->m_mutex, &until) == ETIMEDOUT && !t->m_stop)
+          {
+            pthread_mutex_unlock (&t->m_mutex);
+            t->Write ("running");
+            pthread_mutex_lock (&t->m_mutex);
+          }
+      }
+    pthread_mutex_unlock (&t->m_mutex);
+    return 0;
+  }
+
+  // Plain POSIX I/O and no allocation: no locks or counters shared with the simulation
+  void Write (const char *state)
+  {
+    uint64_t events = __atomic_load_n (&g_eventProgress.scheduled, __ATOMIC_RELAXED);
+    uint64_t step = __atomic_load_n (&g_eventProgress.timeStep, __ATOMIC_RELAXED);
+    uint64_t stopStep = __atomic_load_n (&g_eventProgress.stopStep, __ATOMIC_RELAXED);
+    uint64_t perSecond = __atomic_load_n (&g_eventProgress.stepsPerSecond, __ATOMIC_RELAXED);
+    double scale = perSecond > 0 ? 1.0 / perSecond : 0;
+    double wall = Now ();
+    double span = wall - m_lastWall;
+    // A new run (batch point) starts the counters over
+    if (events < m_lastEvents || step < m_lastStep)
+      {
+        m_lastEvents = 0;
+        m_lastStep = 0;
+      }
+    double eventRate = span > 0 ? (events - m_lastEvents) / span : 0;
+    double simPerWall = span > 0 ? (step - m_lastStep) * scale / span : 0;
+    double eta = -1;
+    if (stopStep > step && simPerWall > 0)
+      {
+        eta = (stopStep - step) * scale / simPerWall;
+      }
+    else if (stopStep > 0 && stopStep <= step)
+      {
+        eta = 0;
+      }
+    m_lastWall = wall;
+    m_lastEvents = events;
+    m_lastStep = step;
+
+    char line[512];
+    int n = snprintf (line, sizeof (line),
+                      "status,%s,state,%s,pid,%d,wall(s),%.3f,simTime(s),%.6f,stopTime(s),%.6f,"
+                      "events,%llu,eventsPerWallSecond,%.1f,simPerWall,%.6g,eta(s),%.1f,rss,%llu,updated,%ld\n",
+                      m_scenario.c_str (), state, (int) getpid (), wall - m_start, step * scale,
+                      stopStep * scale, (unsigned long long) events, eventRate, simPerWall, eta,
+                      (unsigned long long) Resident (), (long) time (0));
+    if (n <= 0)
+      {
+        return;
+      }
+    int fd = open (m_tmpPath.c_str (), O_CREAT | O_WRONLY | O_TRUNC, 0666);
+    if (fd < 0)
+      {
+        return;
+      }
+    bool ok = write (fd, line, n) == n;
+    close (fd);
+    if (ok)
+      {
+        rename (m_tmpPath.c_str (), m_path.c_str ());
+      }
+  }
+
+  // ResidentBytes () without iostreams
+  static uint64_t Resident (void)
+  {
+    char buf[128];
+    int fd = open ("/proc/self/statm", O_RDONLY);
+    if (fd < 0)
+      {
+        return 0;
+      }
+    ssize_t n = read (fd, buf, sizeof (buf) - 1);
+    close (fd);
+    unsigned long long size = 0, resident = 0;
+    if (n <= 0)
+      {
+        return 0;
+      }
+    buf[n] = 0;
+    sscanf (buf, "%llu %llu", &size, &resident);
+    return resident * sysconf (_SC_PAGESIZE);
+  }
+
+  static double Now (void)
+  {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  std::string m_scenario;
+  std::string m_path;
+  std::string m_tmpPath;  // built up front, Write must not allocate
+  double m_interval;
+  bool m_running;
+  bool m_stop;  // guarded by m_mutex
+  pthread_t m_thread;
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_wake;
+  uint64_t m_sampleSteps;     // these three and m_lastSample belong to the simulation
+  uint64_t m_minSampleSteps;
+  uint64_t m_maxSampleSteps;
+  double m_lastSample;
+  double m_start;
+  double m_lastWall;     // the fields below belong to the writing thread
+  uint64_t m_lastEvents;
+  uint64_t m_lastStep;
+};
+
+#endif /* SCENARIO_TELEMETRY_H */
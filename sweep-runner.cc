@@ -0,0 +1,1208 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Parameter-sweep runner for the scenario programs (p1, p2, Ip2, p3).
+//
+// A grid file names the scenario, how to run it and the values of each
+// CommandLine flag; the runner expands the cartesian product and keeps
+// every core busy with one scenario process per point:
+//
+//   scenario p2
+//   command  ./waf --run "p2 {args}"   # {args} is replaced, else appended
+//   jobs     0                         # 0 = all cores
+//   retries  1                         # reruns of a crashed point
+//   stall    600                       # kill a point whose events stop for 600 s
+//   record   ,                         # stdout lines holding this are results
+//   output   p2-sweep                  # per-point stdout/stderr and results
+//   param    queue  DropTail RED
+//   param    MinTh  5 10 15 20 25
+//
+// Points are dispatched longest first, using the wall times of earlier
+// sweeps kept in <output>/history; a point never seen before is estimated
+// from the recorded points sharing most of its values. Idle cores pull the
+// next point from the shared queue, so no core waits while work remains.
+//
+// Scenarios built with result-cache.h report cache hits on stderr; with
+// SCENARIO_CACHE_DIR set, the summary includes the sweep's hit rate.
+// Points run with --instrument log a runProfile record (phase wall times,
+// event rate) on stderr; those go to <output>/profile.csv with the point's
+// parameters in front, like the results.
+//
+// With "stall" set, every point runs with
+// SCENARIO_STATUS_FILE=<output>/<scenario>-<n>.status (see
+// scenario-telemetry.h), and a point whose event count or simulated time
+// has not moved for that many seconds after its simulation started is
+// killed with its process group and retried like a crash; the limit has to
+// exceed the longest single event and the run's teardown.
+//
+// Every point runs in its own process group. Interrupting the runner
+// (Ctrl-C, SIGTERM) kills those groups before it exits.
+//
+// With "refine <key>" the parameter values are only the coarse grid of an
+// adaptive sweep over numeric parameters (e.g. p1's windowSize, queueSize
+// and segSize). <key> names the result field mapped, summed over a point's
+// records (p1: goodput over its flows):
+//
+//   refine    goodput
+//   tolerance 0.05     # split where neighbours differ by > 5% of the range
+//   budget    200      # runs in total, coarse grid included (0 = no limit);
+//                      # a budget below the coarse grid is rejected
+//   levels    4        # halvings of the coarse spacing allowed (0..16)
+//   param     windowSize log 2000 8000 32000   # "log": split geometrically
+//
+// Each box between evaluated points is interpolated multilinearly from its
+// corners. Boxes whose neighbouring corners disagree by more than the
+// tolerance are split in half along the worst axis, worst box first, and
+// only the missing points on the split plane are run. This repeats until
+// the budget is spent or no box disagrees, so the runs gather around sharp
+// transitions (window beyond bandwidth-delay product plus queue) instead of
+// flat regions. <output>/refine.csv holds the metric of every point; the
+// summary compares the runs with a uniform grid at the finest spacing the
+// refinement reached, and reports how far the interpolant was off at the
+// points added.
+//
+// Usage: sweep-runner <grid file>
+//
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "worker-pool.h"
+
+struct SweepParam
+{
+  std::string name;
+  std::vector<std::string> values;
+  bool log;  // refinement splits intervals geometrically
+};
+
+struct SweepGrid
+{
+  std::string scenario;
+  std::string command;
+  uint32_t jobs;
+  uint32_t retries;
+  double stall;  // seconds without event progress before a point is killed, 0 = never
+  std::string record;
+  std::string output;
+  std::vector<SweepParam> params;
+  std::string refine;  // result key of an adaptive sweep, empty = full grid
+  double tolerance;    // of the metric's range
+  uint32_t budget;     // runs, 0 = no limit
+  uint32_t levels;     // halvings of the coarse spacing
+};
+
+struct SweepPoint
+{
+  std::vector<std::string> values;  // one per grid parameter
+  std::string args;                 // "--name=value ..." as passed to the scenario
+  double estimate;                  // expected wall time (s)
+  uint32_t attempts;
+  bool measured;                    // a record held the refine key
+  double metric;                    // its sum over the point's records
+};
+
+static bool
+ReadGrid (const char *fileName, SweepGrid &grid)
+{
+  std::ifstream in (fileName);
+  if (!in)
+    {
+      std::cerr << "sweep-runner: cannot open " << fileName << std::endl;
+      return false;
+    }
+  grid.jobs = 0;
+  grid.retries = 1;
+  grid.stall = 0;
+  grid.record = ",";
+  grid.tolerance = 0.05;
+  grid.budget = 0;
+  grid.levels = 3;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      // Comments run to the end of the line, except inside the command
+      std::istringstream words (line);
+      std::string key;
+      if (!(words >> key) || key[0] == '#')
+        {
+          continue;
+        }
+      std::string rest;
+      std::getline (words, rest);
+      rest.erase (0, rest.find_first_not_of (" \t"));
+      if (key != "command" && rest.find ('#') != std::string::npos)
+        {
+          rest.erase (rest.find ('#'));
+        }
+      rest.erase (rest.find_last_not_of (" \t") + 1);
+
+      if (key == "scenario")
+        {
+          grid.scenario = rest;
+        }
+      else if (key == "command")
+        {
+          grid.command = rest;
+        }
+      else if (key == "jobs")
+        {
+          grid.jobs = atoi (rest.c_str ());
+        }
+      else if (key == "retries")
+        {
+          grid.retries = atoi (rest.c_str ());
+        }
+      else if (key == "stall")
+        {
+          grid.stall = atof (rest.c_str ());
+        }
+      else if (key == "record")
+        {
+          grid.record = rest;
+        }
+      else if (key == "output")
+        {
+          grid.output = rest;
+        }
+      else if (key == "refine")
+        {
+          grid.refine = rest;
+        }
+      else if (key == "tolerance")
+        {
+          grid.tolerance = atof (rest.c_str ());
+        }
+      else if (key == "budget")
+        {
+          grid.budget = atoi (rest.c_str ());
+        }
+      else if (key == "levels")
+        {
+          // The lattice step is 1 << levels
+          char *end;
+          long levels = strtol (rest.c_str (), &end, 10);
+          if (rest.empty () || *end != 0 || levels < 0 || levels > 16)
+            {
+              std::cerr << "sweep-runner: levels " << rest << " is not a number from 0 to 16" << std::endl;
+              return false;
+            }
+          grid.levels = levels;
+        }
+      else if (key == "param")
+        {
+          std::istringstream values (rest);
+          SweepParam p;
+          values >> p.name;
+          p.log = false;
+          std::string v;
+          while (values >> v)
+            {
+              if (v == "log" && p.values.empty () && !p.log)
+                {
+                  p.log = true;
+                  continue;
+                }
+              p.values.push_back (v);
+            }
+          if (p.values.empty ())
+            {
+              std::cerr << "sweep-runner: parameter " << p.name << " has no values" << std::endl;
+              return false;
+            }
+          grid.params.push_back (p);
+        }
+      else
+        {
+          std::cerr << "sweep-runner: unknown key " << key << std::endl;
+          return false;
+        }
+    }
+  if (grid.scenario.empty () || grid.command.empty ())
+    {
+      std::cerr << "sweep-runner: the grid needs a scenario and a command" << std::endl;
+      return false;
+    }
+  if (grid.output.empty ())
+    {
+      grid.output = grid.scenario + "-sweep";
+    }
+  // Refinement places new values between the coarse ones
+  for (uint32_t i = 0; i < grid.params.size () && !grid.refine.empty (); i++)
+    {
+      const SweepParam &p = grid.params[i];
+      for (uint32_t k = 0; k < p.values.size (); k++)
+        {
+          char *end;
+          double v = strtod (p.values[k].c_str (), &end);
+          if (*end != 0 || (p.log && v <= 0)
+              || (k > 0 && v <= strtod (p.values[k - 1].c_str (), 0)))
+            {
+              std::cerr << "sweep-runner: refine needs increasing numeric values"
+                        << (p.log ? " above 0" : "") << " for " << p.name << std::endl;
+              return false;
+            }
+        }
+    }
+  // The coarse grid always runs in full, so it has to fit in the budget
+  uint64_t coarse = 1;
+  for (uint32_t i = 0; i < grid.params.size (); i++)
+    {
+      coarse *= grid.params[i].values.size ();
+    }
+  if (!grid.refine.empty () && grid.budget > 0 && coarse > grid.budget)
+    {
+      std::cerr << "sweep-runner: budget " << grid.budget << " is below the "
+                << coarse << " runs of the coarse grid" << std::endl;
+      return false;
+    }
+  return true;
+}
+
+static SweepPoint
+MakePoint (const SweepGrid &grid, const std::vector<std::string> &values)
+{
+  SweepPoint point;
+  std::ostringstream args;
+  for (uint32_t i = 0; i < grid.params.size (); i++)
+    {
+      args << (i ? " " : "") << "--" << grid.params[i].name << "=" << values[i];
+    }
+  point.values = values;
+  point.args = args.str ();
+  point.estimate = 0;
+  point.attempts = 0;
+  point.measured = false;
+  point.metric = 0;
+  return point;
+}
+
+// Cartesian product of the parameter values, last parameter fastest
+static std::vector<SweepPoint>
+ExpandGrid (const SweepGrid &grid)
+{
+  std::vector<SweepPoint> points;
+  std::vector<uint32_t> digit (grid.params.size (), 0);
+  while (true)
+    {
+      std::vector<std::string> values;
+      for (uint32_t i = 0; i < grid.params.size (); i++)
+        {
+          values.push_back (grid.params[i].values[digit[i]]);
+        }
+      points.push_back (MakePoint (grid, values));
+
+      int32_t i = (int32_t) grid.params.size () - 1;
+      for (; i >= 0; i--)
+        {
+          if (++digit[i] < grid.params[i].values.size ())
+            {
+              break;
+            }
+          digit[i] = 0;
+        }
+      if (i < 0)
+        {
+          return points;
+        }
+    }
+}
+
+// Wall times of earlier sweeps: one "<seconds> <args>" line per finished point
+static std::vector<std::pair<double, std::string> >
+ReadHistory (const std::string &fileName)
+{
+  std::vector<std::pair<double, std::string> > history;
+  std::ifstream in (fileName.c_str ());
+  double wall;
+  std::string args;
+  while (in >> wall && std::getline (in, args))
+    {
+      args.erase (0, args.find_first_not_of (' '));
+      history.push_back (std::make_pair (wall, args));
+    }
+  return history;
+}
+
+static uint32_t
+SharedValues (const std::string &a, const std::string &b)
+{
+  std::istringstream wa (a);
+  std::string w;
+  uint32_t shared = 0;
+  while (wa >> w)
+    {
+      std::istringstream wb (b);
+      std::string v;
+      while (wb >> v)
+        {
+          if (v == w)
+            {
+              shared++;
+              break;
+            }
+        }
+    }
+  return shared;
+}
+
+// Mean wall time of the recorded points closest to this one
+static double
+Estimate (const SweepPoint &point, const std::vector<std::pair<double, std::string> > &history)
+{
+  uint32_t best = 0;
+  double sum = 0;
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < history.size (); i++)
+    {
+      uint32_t shared = SharedValues (point.args, history[i].second);
+      if (shared > best)
+        {
+          best = shared;
+          sum = 0;
+          n = 0;
+        }
+      if (shared == best)
+        {
+          sum += history[i].first;
+          n++;
+        }
+    }
+  return n > 0 ? sum / n : 1.0;
+}
+
+static std::string
+PointFile (const SweepGrid &grid, uint32_t index, const char *suffix)
+{
+  std::ostringstream name;
+  name << grid.output << "/" << grid.scenario << "-" << index << suffix;
+  return name.str ();
+}
+
+// Value following name in the one-line status file, empty if there is none
+static std::string
+StatusField (const std::string &statusFile, const std::string &name)
+{
+  std::ifstream in (statusFile.c_str ());
+  std::string line;
+  std::getline (in, line);
+  std::string key = "," + name + ",";
+  size_t at = line.find (key);
+  if (at == std::string::npos)
+    {
+      return "";
+    }
+  at += key.size ();
+  return line.substr (at, line.find (',', at) - at);
+}
+
+// Scenario name and the point's parameter values, the key of every record
+static std::string
+PointPrefix (const SweepGrid &grid, const SweepPoint &point)
+{
+  std::ostringstream prefix;
+  prefix << grid.scenario;
+  for (uint32_t i = 0; i < grid.params.size (); i++)
+    {
+      prefix << "," << grid.params[i].name << "," << point.values[i];
+    }
+  return prefix.str ();
+}
+
+// Process group of the point this worker runs, 0 while none
+static volatile sig_atomic_t g_pointGroup = 0;
+
+// The scenario runs in its own process group, which no terminal or parent
+// signal reaches; take it down before the worker goes
+static void
+KillPoint (int sig)
+{
+  if (g_pointGroup > 0)
+    {
+      kill (-g_pointGroup, SIGKILL);
+    }
+  signal (sig, SIG_DFL);
+  raise (sig);
+}
+
+/**
+ * Runs one point in the worker process: the scenario's stdout is captured
+ * and its stderr goes to a file. Returns "<wait status> <cpu seconds>
+ * <cache hits> <cache misses> <stalled>" on the first line followed by the
+ * scenario's stdout.
+ */
+class PointJob
+{
+public:
+  PointJob (const SweepGrid &grid, const std::vector<SweepPoint> &points)
+    : m_grid (grid),
+      m_points (points)
+  {
+  }
+
+  std::string operator() (uint32_t index)
+  {
+    std::string command = m_grid.command;
+    size_t at = command.find ("{args}");
+    if (at != std::string::npos)
+      {
+        command.replace (at, 6, m_points[index].args);
+      }
+    else
+      {
+        command += " " + m_points[index].args;
+      }
+
+    std::string statusFile = PointFile (m_grid, index, ".status");
+    std::remove (statusFile.c_str ());
+    int fds[2];
+    if (pipe (fds) != 0)
+      {
+        return "-1 0 0 0 0\n";
+      }
+    // Signals the runner was started with ignored stay ignored
+    if (signal (SIGINT, SIG_IGN) != SIG_IGN)
+      {
+        signal (SIGINT, KillPoint);
+      }
+    if (signal (SIGTERM, SIG_IGN) != SIG_IGN)
+      {
+        signal (SIGTERM, KillPoint);
+      }
+    // Held back until the group exists and KillPoint knows it
+    sigset_t terminate, old;
+    sigemptyset (&terminate);
+    sigaddset (&terminate, SIGINT);
+    sigaddset (&terminate, SIGTERM);
+    sigprocmask (SIG_BLOCK, &terminate, &old);
+    pid_t pid = fork ();
+    if (pid == 0)
+      {
+        // Own process group, so a stalled or interrupted point goes down
+        // with its children
+        setpgid (0, 0);
+        sigprocmask (SIG_SETMASK, &old, 0);
+        close (fds[0]);
+        dup2 (fds[1], 1);
+        close (fds[1]);
+        FILE *err = fopen (PointFile (m_grid, index, ".err").c_str (), "w");
+        if (err)
+          {
+            dup2 (fileno (err), 2);
+          }
+        // Only stall detection reads the file; the sampling is not free
+        if (m_grid.stall > 0)
+          {
+            setenv ("SCENARIO_STATUS_FILE", statusFile.c_str (), 1);
+          }
+        else
+          {
+            unsetenv ("SCENARIO_STATUS_FILE");
+          }
+        execl ("/bin/sh", "sh", "-c", command.c_str (), (char *) 0);
+        _exit (127);
+      }
+    if (pid > 0)
+      {
+        setpgid (pid, pid);
+        g_pointGroup = pid;
+      }
+    sigprocmask (SIG_SETMASK, &old, 0);
+    close (fds[1]);
+    std::string out;
+    char buf[4096];
+    bool stalled = false;
+    std::string lastEvents;
+    double lastProgress = WorkerPool::Now ();
+    while (true)
+      {
+        struct pollfd pfd;
+        pfd.fd = fds[0];
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = poll (&pfd, 1, m_grid.stall > 0 ? 1000 : -1);
+        if (ready > 0)
+          {
+            ssize_t n = read (fds[0], buf, sizeof (buf));
+            if (n > 0)
+              {
+                out.append (buf, n);
+              }
+            else if (n == 0 || errno != EINTR)
+              {
+                break;
+              }
+          }
+        else if (ready < 0 && errno != EINTR)
+          {
+            break;
+          }
+        if (m_grid.stall > 0 && !stalled && pid > 0)
+          {
+            std::string events = StatusField (statusFile, "events");
+            double now = WorkerPool::Now ();
+            // Before the first event and after the run there is nothing to count
+            if (events != lastEvents || events.empty () || events == "0"
+                || StatusField (statusFile, "state") == "done")
+              {
+                lastEvents = events;
+                lastProgress = now;
+              }
+            else if (now - lastProgress > m_grid.stall)
+              {
+                stalled = true;
+                kill (-pid, SIGKILL);
+              }
+          }
+      }
+    close (fds[0]);
+    int status = -1;
+    if (pid > 0)
+      {
+        waitpid (pid, &status, 0);
+        g_pointGroup = 0;
+      }
+    struct rusage usage;
+    getrusage (RUSAGE_CHILDREN, &usage);
+    double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6
+      + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+    // Result cache lookups the scenario logged
+    uint32_t hits = 0, misses = 0;
+    std::ifstream err (PointFile (m_grid, index, ".err").c_str ());
+    std::string line;
+    while (std::getline (err, line))
+      {
+        if (line.compare (0, 15, "resultCache,hit") == 0)
+          {
+            hits++;
+          }
+        else if (line.compare (0, 16, "resultCache,miss") == 0)
+          {
+            misses++;
+          }
+      }
+    std::ostringstream head;
+    head << status << " " << cpu << " " << hits << " " << misses << " " << stalled << "\n";
+    return head.str () + out;
+  }
+
+private:
+  const SweepGrid &m_grid;
+  const std::vector<SweepPoint> &m_points;
+};
+
+static bool
+ByEstimate (const std::pair<double, uint32_t> &a, const std::pair<double, uint32_t> &b)
+{
+  return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+// Value after the field named key in a "key,value,..." record
+static bool
+RecordValue (const std::string &line, const std::string &key, double &value)
+{
+  std::istringstream fields (line);
+  std::string field;
+  while (std::getline (fields, field, ','))
+    {
+      if (field == key && std::getline (fields, field, ','))
+        {
+          char *end;
+          value = strtod (field.c_str (), &end);
+          return end != field.c_str ();
+        }
+    }
+  return false;
+}
+
+// Output files and counters of a sweep, shared by its rounds
+struct SweepState
+{
+  explicit SweepState (const SweepGrid &grid)
+    : history (ReadHistory (grid.output + "/history")),
+      results ((grid.output + "/results.csv").c_str (), std::ios::app),
+      profile ((grid.output + "/profile.csv").c_str (), std::ios::app),
+      historyOut ((grid.output + "/history").c_str (), std::ios::app),
+      busy (0),
+      cpu (0),
+      done (0),
+      records (0),
+      retried (0),
+      stalled (0),
+      cacheHits (0),
+      cacheMisses (0)
+  {
+  }
+
+  std::vector<std::pair<double, std::string> > history;
+  std::ofstream results;
+  std::ofstream profile;
+  std::ofstream historyOut;
+  std::vector<uint32_t> failed;
+  double busy, cpu;
+  uint32_t done, records, retried, stalled, cacheHits, cacheMisses;
+};
+
+// Runs the given points on the pool, longest first, until each finished or failed
+static void
+RunPoints (const SweepGrid &grid, std::vector<SweepPoint> &points, const std::vector<uint32_t> &indices,
+           WorkerPool &pool, SweepState &state)
+{
+  std::vector<std::pair<double, uint32_t> > order;
+  for (uint32_t i = 0; i < indices.size (); i++)
+    {
+      SweepPoint &point = points[indices[i]];
+      point.estimate = Estimate (point, state.history);
+      order.push_back (std::make_pair (point.estimate, indices[i]));
+    }
+  std::sort (order.begin (), order.end (), ByEstimate);
+  // Queue of point indices, longest first; retries go to the front
+  std::vector<uint32_t> queue;
+  for (uint32_t i = 0; i < order.size (); i++)
+    {
+      queue.push_back (order[order.size () - 1 - i].second);
+    }
+
+  PointJob job (grid, points);
+  while (true)
+    {
+      while (!queue.empty () && !pool.IsFull ())
+        {
+          uint32_t index = queue.back ();
+          if (!pool.Start (index, job))
+            {
+              break;
+            }
+          queue.pop_back ();
+          points[index].attempts++;
+        }
+      WorkerResult result;
+      if (!pool.WaitAny (result))
+        {
+          break;
+        }
+      SweepPoint &point = points[result.job];
+      state.busy += result.wallSeconds;
+
+      std::istringstream out (result.output);
+      int status = -1;
+      double pointCpu = 0;
+      uint32_t hits = 0, misses = 0;
+      int pointStalled = 0;
+      out >> status >> pointCpu >> hits >> misses >> pointStalled;
+      state.cpu += pointCpu;
+      state.cacheHits += hits;
+      state.cacheMisses += misses;
+      std::string line;
+      std::getline (out, line);
+
+      bool ok = WIFEXITED (result.status) && WEXITSTATUS (result.status) == 0
+        && status != -1 && WIFEXITED (status) && WEXITSTATUS (status) == 0;
+      std::ofstream log (PointFile (grid, result.job, ".out").c_str ());
+      log << result.output.substr (result.output.find ('\n') + 1);
+      if (pointStalled)
+        {
+          state.stalled++;
+          std::cerr << "sweep-runner: STALLED " << grid.scenario << " " << point.args
+                    << " (no events for " << grid.stall << "s, killed)" << std::endl;
+        }
+      if (!ok)
+        {
+          if (point.attempts <= grid.retries)
+            {
+              state.retried++;
+              queue.push_back (result.job);
+              continue;
+            }
+          state.failed.push_back (result.job);
+          std::cerr << "sweep-runner: FAILED " << grid.scenario << " " << point.args
+                    << " (status " << status << ", " << point.attempts << " attempts)" << std::endl;
+          continue;
+        }
+
+      // Result records keep the point's parameters in front
+      while (std::getline (out, line))
+        {
+          if (line.find (grid.record) == std::string::npos)
+            {
+              continue;
+            }
+          state.results << PointPrefix (grid, point) << "," << line << "\n";
+          state.records++;
+          double value;
+          if (!grid.refine.empty () && RecordValue (line, grid.refine, value))
+            {
+              point.metric += value;
+              point.measured = true;
+            }
+        }
+      state.results.flush ();
+      std::ifstream err (PointFile (grid, result.job, ".err").c_str ());
+      while (std::getline (err, line))
+        {
+          if (line.compare (0, 11, "runProfile,") == 0)
+            {
+              state.profile << PointPrefix (grid, point) << "," << line << "\n";
+            }
+        }
+      state.profile.flush ();
+      state.historyOut << result.wallSeconds << " " << point.args << "\n";
+      state.historyOut.flush ();
+      state.done++;
+      std::cerr << "sweep-runner: " << state.done + state.failed.size () << "/" << points.size ()
+                << " " << point.args << " " << result.wallSeconds << "s (estimate "
+                << point.estimate << "s)" << std::endl;
+    }
+}
+
+/**
+ * Adaptive sweep over a lattice that halves every coarse interval "levels"
+ * times; lattice coordinates are turned into flag values by interpolating
+ * between the coarse values. Points are created on demand, and two
+ * coordinates that round to the same flags share one run.
+ */
+class GridRefiner
+{
+public:
+  GridRefiner (const SweepGrid &grid, std::vector<SweepPoint> &points)
+    : m_grid (grid),
+      m_points (points),
+      m_step (1u << grid.levels),
+      m_rounds (0),
+      m_residuals (0),
+      m_residualSum (0),
+      m_residualMax (0)
+  {
+    for (uint32_t a = 0; a < grid.params.size (); a++)
+      {
+        m_size.push_back ((grid.params[a].values.size () - 1) * m_step);
+        bool integer = true;
+        for (uint32_t k = 0; k < grid.params[a].values.size (); k++)
+          {
+            integer = integer && grid.params[a].values[k].find_first_of (".eE") == std::string::npos;
+          }
+        m_integer.push_back (integer);
+      }
+  }
+
+  // Points to run next, empty when the budget is spent or nothing disagrees
+  std::vector<uint32_t> NextRound (void)
+  {
+    std::vector<uint32_t> round;
+    if (m_rounds++ == 0)
+      {
+        CoarseCells ();
+        for (uint32_t c = 0; c < m_cells.size (); c++)
+          {
+            for (uint32_t mask = 0; mask < (1u << m_size.size ()); mask++)
+              {
+                PointAt (Corner (m_cells[c], mask), round);
+              }
+          }
+        return round;
+      }
+    CollectResiduals ();
+
+    double low = 0, high = 0;
+    bool any = false;
+    for (uint32_t i = 0; i < m_points.size (); i++)
+      {
+        if (m_points[i].measured)
+          {
+            low = any ? std::min (low, m_points[i].metric) : m_points[i].metric;
+            high = any ? std::max (high, m_points[i].metric) : m_points[i].metric;
+            any = true;
+          }
+      }
+    double threshold = m_grid.tolerance * (high - low);
+    if (!any || high <= low)
+      {
+        return round;
+      }
+
+    // Splits whose plane was already run cost nothing; their halves are
+    // looked at again straight away
+    bool split = true;
+    while (round.empty () && split)
+      {
+        split = false;
+        std::vector<std::pair<double, uint32_t> > worst;
+        for (uint32_t c = 0; c < m_cells.size (); c++)
+          {
+            uint32_t axis;
+            double score = Disagreement (m_cells[c], axis);
+            if (score > threshold)
+              {
+                worst.push_back (std::make_pair (score, c));
+              }
+          }
+        std::sort (worst.begin (), worst.end (), ByEstimate);
+        for (uint32_t w = 0; w < worst.size (); w++)
+          {
+            split = Split (worst[w].second, round) || split;
+          }
+      }
+    return round;
+  }
+
+  // Metric of every measured point, keyed like the results
+  void WriteSurface (const std::string &fileName) const
+  {
+    std::ofstream out (fileName.c_str ());
+    for (uint32_t i = 0; i < m_points.size (); i++)
+      {
+        if (m_points[i].measured)
+          {
+            out << PointPrefix (m_grid, m_points[i]) << "," << m_grid.refine << "," << m_points[i].metric << "\n";
+          }
+      }
+  }
+
+  // Summary fields: runs against the uniform grid at the finest spacing reached
+  void Print (std::ostream &os) const
+  {
+    double uniform = 1;
+    for (uint32_t a = 0; a < m_size.size (); a++)
+      {
+        uint32_t finest = m_size[a];
+        for (uint32_t c = 0; c < m_cells.size (); c++)
+          {
+            uint32_t width = m_cells[c].hi[a] - m_cells[c].lo[a];
+            finest = width > 0 ? std::min (finest, width) : finest;
+          }
+        uniform *= finest > 0 ? m_size[a] / finest + 1 : 1;
+      }
+    os << ",refineRuns," << m_points.size ();
+    os << ",uniformRuns," << uniform;
+    os << ",runsSaved," << (uniform > 0 ? 1 - m_points.size () / uniform : 0);
+    os << ",rounds," << m_rounds - 1;
+    os << ",cells," << m_cells.size ();
+    os << ",meanResidual," << (m_residuals > 0 ? m_residualSum / m_residuals : 0);
+    os << ",maxResidual," << m_residualMax;
+  }
+
+private:
+  typedef std::vector<uint32_t> Coord;
+
+  struct Cell
+  {
+    Coord lo;
+    Coord hi;
+  };
+
+  void CoarseCells (void)
+  {
+    Cell cell;
+    for (uint32_t a = 0; a < m_size.size (); a++)
+      {
+        cell.lo.push_back (0);
+        cell.hi.push_back (std::min (m_size[a], m_step));
+      }
+    m_cells.push_back (cell);
+    // Step each axis through its coarse intervals, like ExpandGrid
+    for (uint32_t a = 0; a < m_size.size (); a++)
+      {
+        uint32_t n = m_cells.size ();
+        for (uint32_t c = 0; c < n; c++)
+          {
+            for (uint32_t lo = m_step; lo < m_size[a]; lo += m_step)
+              {
+                Cell next = m_cells[c];
+                next.lo[a] = lo;
+                next.hi[a] = lo + m_step;
+                m_cells.push_back (next);
+              }
+          }
+      }
+  }
+
+  // Corner of cell picked by the bits of mask, bit a set = hi on axis a
+  Coord Corner (const Cell &cell, uint32_t mask) const
+  {
+    Coord x = cell.lo;
+    for (uint32_t a = 0; a < x.size (); a++)
+      {
+        x[a] = (mask >> a & 1) ? cell.hi[a] : cell.lo[a];
+      }
+    return x;
+  }
+
+  std::string Value (uint32_t a, uint32_t x) const
+  {
+    const std::vector<std::string> &coarse = m_grid.params[a].values;
+    uint32_t k = x / m_step;
+    if (x % m_step == 0)
+      {
+        return coarse[k];
+      }
+    double v0 = atof (coarse[k].c_str ());
+    double v1 = atof (coarse[k + 1].c_str ());
+    double f = (double) (x % m_step) / m_step;
+    double v = m_grid.params[a].log ? v0 * std::pow (v1 / v0, f) : v0 + (v1 - v0) * f;
+    std::ostringstream value;
+    if (m_integer[a])
+      {
+        value << (long long) std::floor (v + 0.5);
+      }
+    else
+      {
+        value.precision (10);
+        value << v;
+      }
+    return value.str ();
+  }
+
+  // Point of the lattice coordinate, created (and added to round) if new
+  uint32_t PointAt (const Coord &x, std::vector<uint32_t> &round)
+  {
+    std::vector<std::string> values;
+    for (uint32_t a = 0; a < x.size (); a++)
+      {
+        values.push_back (Value (a, x[a]));
+      }
+    SweepPoint point = MakePoint (m_grid, values);
+    std::map<std::string, uint32_t>::const_iterator it = m_byArgs.find (point.args);
+    if (it != m_byArgs.end ())
+      {
+        return it->second;
+      }
+    m_points.push_back (point);
+    m_byArgs[point.args] = m_points.size () - 1;
+    round.push_back (m_points.size () - 1);
+    return m_points.size () - 1;
+  }
+
+  // Existing point of x, or -1
+  int32_t Find (const Coord &x) const
+  {
+    std::vector<std::string> values;
+    for (uint32_t a = 0; a < x.size (); a++)
+      {
+        values.push_back (Value (a, x[a]));
+      }
+    std::map<std::string, uint32_t>::const_iterator it = m_byArgs.find (MakePoint (m_grid, values).args);
+    return it == m_byArgs.end () ? -1 : (int32_t) it->second;
+  }
+
+  // Largest difference between neighbouring corners along an axis that can
+  // still be halved, -1 if the cell cannot be judged or split
+  double Disagreement (const Cell &cell, uint32_t &axis) const
+  {
+    uint32_t d = m_size.size ();
+    std::vector<double> f (1u << d);
+    for (uint32_t mask = 0; mask < f.size (); mask++)
+      {
+        int32_t p = Find (Corner (cell, mask));
+        if (p < 0 || !m_points[p].measured)
+          {
+            return -1;
+          }
+        f[mask] = m_points[p].metric;
+      }
+    double worst = -1;
+    for (uint32_t a = 0; a < d; a++)
+      {
+        if (cell.hi[a] - cell.lo[a] < 2)
+          {
+            continue;
+          }
+        for (uint32_t mask = 0; mask < f.size (); mask++)
+          {
+            if (!(mask >> a & 1) && std::fabs (f[mask | 1u << a] - f[mask]) > worst)
+              {
+                worst = std::fabs (f[mask | 1u << a] - f[mask]);
+                axis = a;
+              }
+          }
+      }
+    return worst;
+  }
+
+  // Multilinear interpolation of the cell's corners at x
+  double Interpolate (const Cell &cell, const Coord &x) const
+  {
+    double value = 0;
+    for (uint32_t mask = 0; mask < (1u << m_size.size ()); mask++)
+      {
+        double weight = 1;
+        for (uint32_t a = 0; a < x.size (); a++)
+          {
+            double t = cell.hi[a] > cell.lo[a] ? (double) (x[a] - cell.lo[a]) / (cell.hi[a] - cell.lo[a]) : 0;
+            weight *= (mask >> a & 1) ? t : 1 - t;
+          }
+        if (weight != 0)
+          {
+            value += weight * m_points[Find (Corner (cell, mask))].metric;
+          }
+      }
+    return value;
+  }
+
+  // Halves cell c along its worst axis if the budget allows the new runs
+  bool Split (uint32_t c, std::vector<uint32_t> &round)
+  {
+    uint32_t axis = 0;
+    if (Disagreement (m_cells[c], axis) < 0)
+      {
+        return false;
+      }
+    Cell cell = m_cells[c];
+    uint32_t mid = (cell.lo[axis] + cell.hi[axis]) / 2;
+    std::vector<Coord> plane;
+    std::set<std::string> missing;
+    for (uint32_t mask = 0; mask < (1u << m_size.size ()); mask++)
+      {
+        Coord x = Corner (cell, mask & ~(1u << axis));
+        x[axis] = mid;
+        plane.push_back (x);
+        if (Find (x) < 0)
+          {
+            std::ostringstream key;
+            for (uint32_t a = 0; a < x.size (); a++)
+              {
+                key << Value (a, x[a]) << " ";
+              }
+            missing.insert (key.str ());
+          }
+      }
+    if (m_grid.budget > 0 && m_points.size () + missing.size () > m_grid.budget)
+      {
+        return false;
+      }
+    for (uint32_t i = 0; i < plane.size (); i++)
+      {
+        uint32_t before = m_points.size ();
+        uint32_t p = PointAt (plane[i], round);
+        if (m_points.size () > before)
+          {
+            m_predicted[p] = Interpolate (cell, plane[i]);
+          }
+      }
+    Cell upper = cell;
+    m_cells[c].hi[axis] = mid;
+    upper.lo[axis] = mid;
+    m_cells.push_back (upper);
+    return true;
+  }
+
+  // How far the interpolant was off at the points the last round added
+  void CollectResiduals (void)
+  {
+    for (std::map<uint32_t, double>::const_iterator it = m_predicted.begin (); it != m_predicted.end (); ++it)
+      {
+        if (m_points[it->first].measured)
+          {
+            double residual = std::fabs (m_points[it->first].metric - it->second);
+            m_residuals++;
+            m_residualSum += residual;
+            m_residualMax = std::max (m_residualMax, residual);
+          }
+      }
+    m_predicted.clear ();
+  }
+
+  const SweepGrid &m_grid;
+  std::vector<SweepPoint> &m_points;
+  uint32_t m_step;              // lattice units per coarse interval
+  std::vector<uint32_t> m_size; // lattice units per axis
+  std::vector<bool> m_integer;  // axis takes integer flags
+  std::vector<Cell> m_cells;
+  std::map<std::string, uint32_t> m_byArgs;
+  std::map<uint32_t, double> m_predicted;  // new point -> interpolated value
+  uint32_t m_rounds;
+  uint32_t m_residuals;
+  double m_residualSum;
+  double m_residualMax;
+};
+
+int
+main (int argc, char *argv[])
+{
+  if (argc != 2)
+    {
+      std::cerr << "usage: sweep-runner <grid file>" << std::endl;
+      return 2;
+    }
+  SweepGrid grid;
+  if (!ReadGrid (argv[1], grid))
+    {
+      return 2;
+    }
+  mkdir (grid.output.c_str (), 0777);
+
+  WorkerPool pool (grid.jobs);
+  // Ctrl-C or SIGTERM takes the running points down with the runner
+  pool.ForwardTerminationSignals ();
+  SweepState state (grid);
+  std::vector<SweepPoint> points;
+  GridRefiner refiner (grid, points);
+  double start = WorkerPool::Now ();
+  if (grid.refine.empty ())
+    {
+      points = ExpandGrid (grid);
+      std::vector<uint32_t> all;
+      for (uint32_t i = 0; i < points.size (); i++)
+        {
+          all.push_back (i);
+        }
+      RunPoints (grid, points, all, pool, state);
+    }
+  else
+    {
+      std::vector<uint32_t> round;
+      while (!(round = refiner.NextRound ()).empty ())
+        {
+          RunPoints (grid, points, round, pool, state);
+        }
+      refiner.WriteSurface (grid.output + "/refine.csv");
+    }
+
+  std::ofstream failedOut ((grid.output + "/failed.txt").c_str ());
+  for (uint32_t i = 0; i < state.failed.size (); i++)
+    {
+      failedOut << points[state.failed[i]].args << "\n";
+    }
+
+  double wall = WorkerPool::Now () - start;
+  uint32_t cores = pool.GetMaxWorkers ();
+  std::cout << "sweep," << grid.scenario;
+  std::cout << ",points," << points.size ();
+  std::cout << ",done," << state.done;
+  std::cout << ",failed," << state.failed.size ();
+  std::cout << ",retried," << state.retried;
+  if (grid.stall > 0)
+    {
+      std::cout << ",stalled," << state.stalled;
+    }
+  std::cout << ",records," << state.records;
+  std::cout << ",workers," << cores;
+  std::cout << ",wall(s)," << wall;
+  std::cout << ",busy(s)," << state.busy;
+  std::cout << ",cpu(s)," << state.cpu;
+  std::cout << ",slotUtilisation," << (wall > 0 ? state.busy / (cores * wall) : 0);
+  std::cout << ",cpuUtilisation," << (wall > 0 ? state.cpu / (cores * wall) : 0);
+  if (state.cacheHits + state.cacheMisses > 0)
+    {
+      std::cout << ",cacheHits," << state.cacheHits;
+      std::cout << ",cacheMisses," << state.cacheMisses;
+      std::cout << ",cacheHitRate," << (double) state.cacheHits / (state.cacheHits + state.cacheMisses);
+    }
+  if (!grid.refine.empty ())
+    {
+      refiner.Print (std::cout);
+    }
+  std::cout << std::endl;
+  return state.failed.empty () ? 0 : 1;
+}
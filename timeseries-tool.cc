@@ -0,0 +1,575 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Converter and query tool for the columnar time-series files (timeseries.h).
+//
+// Usage: timeseries-tool convert [--format=<f>] [--prefix=<kind>] [--time=<key>]
+//                                <input> <output.tsc>
+//        timeseries-tool info <file.tsc>
+//        timeseries-tool range <file.tsc> <column> <from(s)> <to(s)>
+//        timeseries-tool downsample <file.tsc> <column> <buckets> [<from(s)> <to(s)>]
+//
+// convert reads the existing text outputs line by line, so inputs of any
+// size go through in constant memory. Formats (guessed from the first
+// line unless --format is given):
+//
+//   table    whitespace or comma separated numbers, first column time in
+//            seconds; column names from a leading "#" line (p3's
+//            --throughputFile, gnuplot data)
+//   record   "key,value,key,value" lines as the scenarios print them (p1
+//            results, p3 memory lines, runProfile, status); numeric values
+//            become columns, time is the --time key (default "time(s)") or
+//            the line number; --prefix keeps lines whose first field matches
+//   flows    p2/Ip2 result blocks: "Flow <n>:" then "<label>: <number>"
+//            lines; one row per flow, time is the flow number; columns
+//            are the labels of the first flow
+//   ascii    ns-3 ASCII traces ("+ 1.002 /NodeList/0/DeviceList/1/...");
+//            columns event (+ - r d t as 0..4), node, device, ipLength
+//
+// range prints "time(s),value" rows; downsample prints
+// "start(s),count,min,max,mean" per bucket.
+//
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <stdint.h>
+
+#include "timeseries.h"
+
+static int64_t
+Nanoseconds (double seconds)
+{
+  return (int64_t) llround (seconds * 1e9);
+}
+
+static bool
+ParseNumber (const std::string &text, double &value)
+{
+  if (text.empty ())
+    {
+      return false;
+    }
+  char *end;
+  value = strtod (text.c_str (), &end);
+  return *end == 0 || *end == '\r';
+}
+
+static std::vector<std::string>
+Split (const std::string &line, char separator)
+{
+  std::vector<std::string> fields;
+  std::string field;
+  std::istringstream in (line);
+  while (std::getline (in, field, separator))
+    {
+      fields.push_back (field);
+    }
+  return fields;
+}
+
+static std::vector<std::string>
+SplitBlanks (const std::string &line)
+{
+  std::vector<std::string> fields;
+  std::string field;
+  std::istringstream in (line);
+  while (in >> field)
+    {
+      fields.push_back (field);
+    }
+  return fields;
+}
+
+// From the first lines of the input
+static std::string
+GuessFormat (std::istream &in)
+{
+  std::string first;
+  std::string line;
+  for (uint32_t n = 0; n < 50 && std::getline (in, line); )
+    {
+      size_t start = line.find_first_not_of (" \t\r");
+      if (start == std::string::npos)
+        {
+          continue;
+        }
+      if (line.compare (start, 5, "Flow ") == 0)
+        {
+          return "flows";
+        }
+      first = n++ == 0 ? line : first;
+    }
+  if (first.size () > 2 && std::strchr ("+-rdt", first[0]) && first[1] == ' ')
+    {
+      return "ascii";
+    }
+  std::vector<std::string> fields = Split (first, ',');
+  double value;
+  if (!first.empty () && first[0] != '#' && fields.size () > 1 && !ParseNumber (fields[0], value))
+    {
+      return "record";
+    }
+  return "table";
+}
+
+static bool
+ConvertTable (std::istream &in, TimeSeriesWriter &out, const std::string &path)
+{
+  std::vector<std::string> header;
+  std::vector<double> row;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      if (line.empty ())
+        {
+          continue;
+        }
+      if (line[0] == '#')
+        {
+          if (header.empty () && !out.IsOpen ())
+            {
+              header = SplitBlanks (line.substr (1));
+            }
+          continue;
+        }
+      for (uint32_t i = 0; i < line.size (); i++)
+        {
+          line[i] = line[i] == ',' ? ' ' : line[i];
+        }
+      std::vector<std::string> fields = SplitBlanks (line);
+      if (fields.size () < 2)
+        {
+          continue;
+        }
+      if (!out.IsOpen ())
+        {
+          std::vector<std::string> columns;
+          for (uint32_t i = 1; i < fields.size (); i++)
+            {
+              std::ostringstream name;
+              name << "c" << i;
+              columns.push_back (i < header.size () ? header[i] : name.str ());
+            }
+          if (!out.Open (path, columns))
+            {
+              return false;
+            }
+          row.resize (columns.size ());
+        }
+      double time;
+      if (!ParseNumber (fields[0], time))
+        {
+          continue;
+        }
+      for (uint32_t c = 0; c < row.size (); c++)
+        {
+          if (c + 1 >= fields.size () || !ParseNumber (fields[c + 1], row[c]))
+            {
+              row[c] = std::numeric_limits<double>::quiet_NaN ();
+            }
+        }
+      out.Append (Nanoseconds (time), &row[0]);
+    }
+  return out.IsOpen ();
+}
+
+static bool
+ConvertRecords (std::istream &in, TimeSeriesWriter &out, const std::string &path,
+                const std::string &prefix, const std::string &timeKey)
+{
+  std::vector<std::string> columns;
+  std::vector<double> row;
+  uint64_t number = 0;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      std::vector<std::string> fields = Split (line, ',');
+      if (fields.size () < 2 || (!prefix.empty () && fields[0] != prefix))
+        {
+          continue;
+        }
+      double time = number++;
+      std::vector<std::pair<std::string, double> > numeric;
+      for (uint32_t i = 0; i + 1 < fields.size (); i += 2)
+        {
+          double value;
+          if (!ParseNumber (fields[i + 1], value))
+            {
+              continue;
+            }
+          if (fields[i] == timeKey)
+            {
+              time = value;
+            }
+          else
+            {
+              numeric.push_back (std::make_pair (fields[i], value));
+            }
+        }
+      if (numeric.empty ())
+        {
+          continue;
+        }
+      // Columns are fixed by the first record
+      if (!out.IsOpen ())
+        {
+          for (uint32_t i = 0; i < numeric.size (); i++)
+            {
+              columns.push_back (numeric[i].first);
+            }
+          if (!out.Open (path, columns))
+            {
+              return false;
+            }
+          row.resize (columns.size ());
+        }
+      for (uint32_t c = 0; c < columns.size (); c++)
+        {
+          row[c] = std::numeric_limits<double>::quiet_NaN ();
+          for (uint32_t i = 0; i < numeric.size (); i++)
+            {
+              if (numeric[i].first == columns[c])
+                {
+                  row[c] = numeric[i].second;
+                  break;
+                }
+            }
+        }
+      out.Append (Nanoseconds (time), &row[0]);
+    }
+  return out.IsOpen ();
+}
+
+// Writes the row of one flow block; the first one fixes the columns
+static bool
+WriteFlow (TimeSeriesWriter &out, const std::string &path,
+           const std::vector<std::string> &columns, std::vector<double> &row, double flow)
+{
+  if (columns.empty ())
+    {
+      return true;
+    }
+  if (!out.IsOpen () && !out.Open (path, columns))
+    {
+      return false;
+    }
+  out.Append (Nanoseconds (flow), &row[0]);
+  row.assign (row.size (), std::numeric_limits<double>::quiet_NaN ());
+  return true;
+}
+
+static bool
+ConvertFlows (std::istream &in, TimeSeriesWriter &out, const std::string &path)
+{
+  // A row is written when the next "Flow <n>:" header (or the end of the
+  // input) closes its block, so only the current flow is held
+  std::vector<std::string> columns;
+  std::vector<double> row;
+  double flow = 0;
+  bool inFlow = false;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      // p2 prints "Flow 0:\t\tGoodput: 123" on one line, Ip2 on separate ones
+      size_t colon;
+      std::vector<std::string> label;
+      std::vector<std::string> value;
+      double number;
+      while ((colon = line.find (':')) != std::string::npos)
+        {
+          label = SplitBlanks (line.substr (0, colon));
+          line = line.substr (colon + 1);
+          value = SplitBlanks (line);
+          if (label.size () != 2 || label[0] != "Flow" || !ParseNumber (label[1], number))
+            {
+              break;
+            }
+          if (inFlow && !WriteFlow (out, path, columns, row, flow))
+            {
+              return false;
+            }
+          flow = number;
+          inFlow = true;
+          label.clear ();
+        }
+      if (!inFlow || label.empty () || value.empty () || !ParseNumber (value[0], number))
+        {
+          continue;
+        }
+      std::string name;
+      for (uint32_t i = 0; i < label.size (); i++)
+        {
+          name += label[i];
+        }
+      uint32_t c = 0;
+      while (c < columns.size () && columns[c] != name)
+        {
+          c++;
+        }
+      if (c < columns.size ())
+        {
+          row[c] = number;
+        }
+      // Labels first seen after the first block have no column and are dropped
+      else if (!out.IsOpen ())
+        {
+          columns.push_back (name);
+          row.push_back (number);
+        }
+    }
+  if (inFlow && !WriteFlow (out, path, columns, row, flow))
+    {
+      return false;
+    }
+  return out.IsOpen ();
+}
+
+// Number after "tag" in path ("/NodeList/3/..."), or NaN
+static double
+PathIndex (const std::string &path, const char *tag)
+{
+  size_t at = path.find (tag);
+  if (at == std::string::npos)
+    {
+      return std::numeric_limits<double>::quiet_NaN ();
+    }
+  return atof (path.c_str () + at + std::strlen (tag));
+}
+
+static bool
+ConvertAscii (std::istream &in, TimeSeriesWriter &out, const std::string &path)
+{
+  std::vector<std::string> columns;
+  columns.push_back ("event");
+  columns.push_back ("node");
+  columns.push_back ("device");
+  columns.push_back ("ipLength");
+  if (!out.Open (path, columns))
+    {
+      return false;
+    }
+  const char *events = "+-rdt";
+  double row[4];
+  std::string line;
+  while (std::getline (in, line))
+    {
+      if (line.size () < 3 || line[1] != ' ' || !std::strchr (events, line[0]))
+        {
+          continue;
+        }
+      char *end;
+      double time = strtod (line.c_str () + 2, &end);
+      if (end == line.c_str () + 2)
+        {
+          continue;
+        }
+      std::string rest (end);
+      size_t space = rest.find (' ', 1);
+      std::string context = rest.substr (0, space);
+      row[0] = std::strchr (events, line[0]) - events;
+      row[1] = PathIndex (context, "/NodeList/");
+      row[2] = PathIndex (context, "/DeviceList/");
+      size_t length = rest.find ("length: ");
+      row[3] = length == std::string::npos ? std::numeric_limits<double>::quiet_NaN ()
+        : atof (rest.c_str () + length + 8);
+      out.Append (Nanoseconds (time), row);
+    }
+  return true;
+}
+
+static bool
+Option (const char *arg, const char *name, std::string &value)
+{
+  size_t n = strlen (name);
+  if (strncmp (arg, name, n) == 0 && arg[n] == '=')
+    {
+      value = arg + n + 1;
+      return true;
+    }
+  return false;
+}
+
+static int
+Usage (void)
+{
+  std::cerr << "usage: timeseries-tool convert [--format=table|record|flows|ascii] [--prefix=<kind>]"
+            << " [--time=<key>] <input> <output.tsc>\n"
+            << "       timeseries-tool info <file.tsc>\n"
+            << "       timeseries-tool range <file.tsc> <column> <from(s)> <to(s)>\n"
+            << "       timeseries-tool downsample <file.tsc> <column> <buckets> [<from(s)> <to(s)>]"
+            << std::endl;
+  return 2;
+}
+
+static int
+Convert (int argc, char *argv[])
+{
+  std::string format;
+  std::string prefix;
+  std::string timeKey = "time(s)";
+  std::vector<std::string> files;
+  for (int i = 2; i < argc; i++)
+    {
+      std::string value;
+      if (Option (argv[i], "--format", value))
+        {
+          format = value;
+        }
+      else if (Option (argv[i], "--prefix", value))
+        {
+          prefix = value;
+        }
+      else if (Option (argv[i], "--time", value))
+        {
+          timeKey = value;
+        }
+      else
+        {
+          files.push_back (argv[i]);
+        }
+    }
+  if (files.size () != 2)
+    {
+      return Usage ();
+    }
+  std::ifstream in (files[0].c_str ());
+  if (!in)
+    {
+      std::cerr << "timeseries-tool: cannot open " << files[0] << std::endl;
+      return 1;
+    }
+  if (format.empty ())
+    {
+      format = GuessFormat (in);
+      in.clear ();
+      in.seekg (0);
+    }
+
+  TimeSeriesWriter out;
+  bool ok;
+  if (format == "table")
+    {
+      ok = ConvertTable (in, out, files[1]);
+    }
+  else if (format == "record")
+    {
+      ok = ConvertRecords (in, out, files[1], prefix, timeKey);
+    }
+  else if (format == "flows")
+    {
+      ok = ConvertFlows (in, out, files[1]);
+    }
+  else if (format == "ascii")
+    {
+      ok = ConvertAscii (in, out, files[1]);
+    }
+  else
+    {
+      return Usage ();
+    }
+  if (!ok)
+    {
+      std::cerr << "timeseries-tool: no " << format << " rows in " << files[0]
+                << " or cannot write " << files[1] << std::endl;
+      return 1;
+    }
+  out.Close ();
+  return 0;
+}
+
+static bool
+OpenColumn (TimeSeriesReader &reader, const char *path, const char *name, uint32_t &column)
+{
+  if (!reader.Open (path))
+    {
+      std::cerr << "timeseries-tool: cannot read " << path << std::endl;
+      return false;
+    }
+  int c = reader.FindColumn (name);
+  if (c < 0)
+    {
+      std::cerr << "timeseries-tool: no column " << name << " in " << path << std::endl;
+      return false;
+    }
+  column = c;
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  if (argc < 3)
+    {
+      return Usage ();
+    }
+  std::string command = argv[1];
+  if (command == "convert")
+    {
+      return Convert (argc, argv);
+    }
+
+  TimeSeriesReader reader;
+  if (command == "info" && argc == 3)
+    {
+      if (!reader.Open (argv[2]))
+        {
+          std::cerr << "timeseries-tool: cannot read " << argv[2] << std::endl;
+          return 1;
+        }
+      std::cout << "rows," << reader.GetRows ();
+      std::cout << ",chunks," << reader.GetChunks ();
+      std::cout << ",start(s)," << reader.GetStart () * 1e-9;
+      std::cout << ",end(s)," << reader.GetEnd () * 1e-9;
+      std::cout << ",complete," << reader.IsComplete ();
+      std::cout << ",columns,";
+      for (uint32_t c = 0; c < reader.GetColumns ().size (); c++)
+        {
+          std::cout << (c ? " " : "") << reader.GetColumns ()[c];
+        }
+      std::cout << std::endl;
+      return 0;
+    }
+
+  uint32_t column;
+  if (command == "range" && argc == 6)
+    {
+      if (!OpenColumn (reader, argv[2], argv[3], column))
+        {
+          return 1;
+        }
+      std::vector<int64_t> times;
+      std::vector<double> values;
+      reader.Range (Nanoseconds (atof (argv[4])), Nanoseconds (atof (argv[5])), column, times, values);
+      std::cout.precision (12);
+      for (uint32_t i = 0; i < times.size (); i++)
+        {
+          std::cout << times[i] * 1e-9 << "," << values[i] << "\n";
+        }
+      return 0;
+    }
+  if (command == "downsample" && (argc == 5 || argc == 7))
+    {
+      if (!OpenColumn (reader, argv[2], argv[3], column))
+        {
+          return 1;
+        }
+      int64_t from = argc == 7 ? Nanoseconds (atof (argv[5])) : reader.GetStart ();
+      int64_t to = argc == 7 ? Nanoseconds (atof (argv[6])) : reader.GetEnd () + 1;
+      std::vector<TimeSeriesBucket> buckets = reader.Downsample (from, to, column, atoi (argv[4]));
+      std::cout.precision (12);
+      for (uint32_t b = 0; b < buckets.size (); b++)
+        {
+          std::cout << buckets[b].start * 1e-9 << "," << buckets[b].count << "," << buckets[b].min
+                    << "," << buckets[b].max << "," << buckets[b].mean << "\n";
+        }
+      return 0;
+    }
+  return Usage ();
+}
@@ -0,0 +1,723 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Chunked, columnar time-series files (.tsc) for scenario trace output.
+//
+// A file holds one int64 time column (nanoseconds, ns-3's resolution) and
+// any number of named double columns. Rows are buffered in memory and
+// written a chunk at a time (4096 rows by default), so appending from the
+// simulation thread is a few stores per row plus one write () per chunk.
+// Inside a chunk every column is stored on its own:
+//
+//   time     zigzag varints of delta-of-delta: one byte per row for a
+//            fixed sampling interval
+//   values   XOR with the previous value, leading and trailing zero bytes
+//            dropped (one control byte, then the remaining bytes); a
+//            repeated value costs one byte
+//
+// Each chunk header carries the chunk's time span and the min, max and sum
+// of every column, and the file ends with an index of all chunks. Readers
+// map the file and decode only the chunks, and within them only the
+// columns, a query touches; downsampling takes whole chunks that fall in
+// one bucket from their header without decoding them. A file whose writer
+// died before Close () has no index; the reader then walks the chunks and
+// keeps every complete one.
+//
+// Layout (little-endian):
+//
+//   file     "TSC1" u32:columns { u16:length name }... chunk... index trailer
+//   chunk    "TSCK" u32:rows i64:first i64:last u32:bytes
+//            { f64:min f64:max f64:sum }...  (per value column)
+//            { u32:length data }...          (time, then each value column)
+//   index    { u64:offset u32:rows i64:first i64:last }...
+//   trailer  u64:indexOffset u32:chunks "TSCE"
+//
+// timeseries-tool converts the existing text outputs and queries files.
+//
+
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace tsc {
+
+static const char FILE_MAGIC[] = "TSC1";
+static const char CHUNK_MAGIC[] = "TSCK";
+static const char END_MAGIC[] = "TSCE";
+static const uint32_t CHUNK_HEADER = 4 + 4 + 8 + 8 + 4;
+static const uint32_t INDEX_ENTRY = 8 + 4 + 8 + 8;
+static const uint32_t TRAILER = 8 + 4 + 4;
+
+template <typename T>
+inline void
+Put (std::string &out, T value)
+{
+  out.append (reinterpret_cast<const char *> (&value), sizeof (value));
+}
+
+template <typename T>
+inline T
+Get (const uint8_t *p)
+{
+  T value;
+  std::memcpy (&value, p, sizeof (value));
+  return value;
+}
+
+inline void
+PutVarint (std::string &out, uint64_t value)
+{
+  while (value >= 0x80)
+    {
+      out.push_back ((char) (value | 0x80));
+      value >>= 7;
+    }
+  out.push_back ((char) value);
+}
+
+inline uint64_t
+GetVarint (const uint8_t *&p)
+{
+  uint64_t value = 0;
+  for (uint32_t shift = 0; shift < 64; shift += 7)
+    {
+      uint8_t byte = *p++;
+      value |= (uint64_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        {
+          break;
+        }
+    }
+  return value;
+}
+
+inline uint64_t
+ZigZag (int64_t value)
+{
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+inline int64_t
+UnZigZag (uint64_t value)
+{
+  return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+inline void
+EncodeTimes (const std::vector<int64_t> &times, std::string &out)
+{
+  int64_t previous = 0;
+  int64_t delta = 0;
+  for (uint32_t i = 0; i < times.size (); i++)
+    {
+      int64_t d = times[i] - previous;
+      PutVarint (out, ZigZag (d - delta));
+      delta = d;
+      previous = times[i];
+    }
+}
+
+inline void
+EncodeValues (const std::vector<double> &values, std::string &out)
+{
+  uint64_t previous = 0;
+  for (uint32_t i = 0; i < values.size (); i++)
+    {
+      uint64_t bits;
+      std::memcpy (&bits, &values[i], sizeof (bits));
+      uint64_t x = bits ^ previous;
+      previous = bits;
+      if (x == 0)
+        {
+          out.push_back (0);
+          continue;
+        }
+      // Control byte: high nibble leading zero bytes, low nibble bytes kept
+      uint32_t lead = 0;
+      while (!(x >> (56 - 8 * lead) & 0xff))
+        {
+          lead++;
+        }
+      uint32_t trail = 0;
+      while (!(x >> (8 * trail) & 0xff))
+        {
+          trail++;
+        }
+      uint32_t kept = 8 - lead - trail;
+      out.push_back ((char) (lead << 4 | kept));
+      for (uint32_t b = 0; b < kept; b++)
+        {
+          out.push_back ((char) (x >> (56 - 8 * (lead + b)) & 0xff));
+        }
+    }
+}
+
+} // namespace tsc
+
+class TimeSeriesWriter
+{
+public:
+  TimeSeriesWriter ()
+    : m_fd (-1),
+      m_offset (0),
+      m_chunkRows (4096),
+      m_chunks (0)
+  {
+  }
+
+  ~TimeSeriesWriter ()
+  {
+    Close ();
+  }
+
+  bool Open (const std::string &path, const std::vector<std::string> &columns, uint32_t chunkRows = 4096)
+  {
+    Close ();
+    m_fd = open (path.c_str (), O_CREAT | O_WRONLY | O_TRUNC, 0666);
+    if (m_fd < 0)
+      {
+        return false;
+      }
+    m_columns = columns;
+    m_chunkRows = chunkRows > 0 ? chunkRows : 1;
+    m_offset = 0;
+    m_chunks = 0;
+    m_index.clear ();
+    m_times.clear ();
+    m_times.reserve (m_chunkRows);
+    m_values.assign (columns.size (), std::vector<double> ());
+    for (uint32_t c = 0; c < columns.size (); c++)
+      {
+        m_values[c].reserve (m_chunkRows);
+      }
+    std::string header (tsc::FILE_MAGIC, 4);
+    tsc::Put<uint32_t> (header, columns.size ());
+    for (uint32_t c = 0; c < columns.size (); c++)
+      {
+        tsc::Put<uint16_t> (header, columns[c].size ());
+        header += columns[c];
+      }
+    return Write (header);
+  }
+
+  bool IsOpen (void) const
+  {
+    return m_fd >= 0;
+  }
+
+  // One row; values holds one entry per column
+  void Append (int64_t time, const double *values)
+  {
+    if (m_fd < 0)
+      {
+        return;
+      }
+    m_times.push_back (time);
+    for (uint32_t c = 0; c < m_values.size (); c++)
+      {
+        m_values[c].push_back (values[c]);
+      }
+    if (m_times.size () >= m_chunkRows)
+      {
+        FlushChunk ();
+      }
+  }
+
+  // Writes the last chunk and the index
+  void Close (void)
+  {
+    if (m_fd < 0)
+      {
+        return;
+      }
+    FlushChunk ();
+    std::string end = m_index;
+    tsc::Put<uint64_t> (end, m_offset);
+    tsc::Put<uint32_t> (end, m_chunks);
+    end.append (tsc::END_MAGIC, 4);
+    Write (end);
+    close (m_fd);
+    m_fd = -1;
+  }
+
+private:
+  TimeSeriesWriter (const TimeSeriesWriter &);  // one owner per file
+  TimeSeriesWriter &operator= (const TimeSeriesWriter &);
+
+  void FlushChunk (void)
+  {
+    uint32_t rows = m_times.size ();
+    if (rows == 0)
+      {
+        return;
+      }
+    int64_t first = m_times[0];
+    int64_t last = m_times[0];
+    for (uint32_t i = 1; i < rows; i++)
+      {
+        first = m_times[i] < first ? m_times[i] : first;
+        last = m_times[i] > last ? m_times[i] : last;
+      }
+
+    std::string stats;
+    std::string blocks;
+    std::string block;
+    tsc::EncodeTimes (m_times, block);
+    tsc::Put<uint32_t> (blocks, block.size ());
+    blocks += block;
+    for (uint32_t c = 0; c < m_values.size (); c++)
+      {
+        const std::vector<double> &v = m_values[c];
+        double min = v[0], max = v[0], sum = 0;
+        for (uint32_t i = 0; i < rows; i++)
+          {
+            min = v[i] < min ? v[i] : min;
+            max = v[i] > max ? v[i] : max;
+            sum += v[i];
+          }
+        tsc::Put<double> (stats, min);
+        tsc::Put<double> (stats, max);
+        tsc::Put<double> (stats, sum);
+        block.clear ();
+        tsc::EncodeValues (v, block);
+        tsc::Put<uint32_t> (blocks, block.size ());
+        blocks += block;
+      }
+
+    std::string chunk (tsc::CHUNK_MAGIC, 4);
+    tsc::Put<uint32_t> (chunk, rows);
+    tsc::Put<int64_t> (chunk, first);
+    tsc::Put<int64_t> (chunk, last);
+    tsc::Put<uint32_t> (chunk, stats.size () + blocks.size ());
+    chunk += stats;
+    chunk += blocks;
+
+    tsc::Put<uint64_t> (m_index, m_offset);
+    tsc::Put<uint32_t> (m_index, rows);
+    tsc::Put<int64_t> (m_index, first);
+    tsc::Put<int64_t> (m_index, last);
+    m_chunks++;
+    Write (chunk);
+
+    m_times.clear ();
+    for (uint32_t c = 0; c < m_values.size (); c++)
+      {
+        m_values[c].clear ();
+      }
+  }
+
+  bool Write (const std::string &bytes)
+  {
+    const char *p = bytes.data ();
+    size_t left = bytes.size ();
+    while (left > 0)
+      {
+        ssize_t n = write (m_fd, p, left);
+        if (n <= 0)
+          {
+            return false;
+          }
+        p += n;
+        left -= n;
+      }
+    m_offset += bytes.size ();
+    return true;
+  }
+
+  int m_fd;
+  uint64_t m_offset;
+  uint32_t m_chunkRows;
+  uint32_t m_chunks;
+  std::vector<std::string> m_columns;
+  std::vector<int64_t> m_times;               // rows of the open chunk
+  std::vector<std::vector<double> > m_values;
+  std::string m_index;
+};
+
+// Rows of one bucket of a downsampling query; min, max and mean are 0 when empty
+struct TimeSeriesBucket
+{
+  int64_t start;
+  uint64_t count;
+  double min;
+  double max;
+  double mean;
+};
+
+class TimeSeriesReader
+{
+public:
+  TimeSeriesReader ()
+    : m_data (0),
+      m_size (0),
+      m_complete (false)
+  {
+  }
+
+  ~TimeSeriesReader ()
+  {
+    Close ();
+  }
+
+  bool Open (const std::string &path)
+  {
+    Close ();
+    int fd = open (path.c_str (), O_RDONLY);
+    if (fd < 0)
+      {
+        return false;
+      }
+    struct stat st;
+    if (fstat (fd, &st) != 0 || st.st_size < 8)
+      {
+        close (fd);
+        return false;
+      }
+    void *data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (data == MAP_FAILED)
+      {
+        return false;
+      }
+    m_data = static_cast<const uint8_t *> (data);
+    m_size = st.st_size;
+    if (!ReadHeader () || !ReadChunks ())
+      {
+        Close ();
+        return false;
+      }
+    return true;
+  }
+
+  void Close (void)
+  {
+    if (m_data)
+      {
+        munmap (const_cast<uint8_t *> (m_data), m_size);
+      }
+    m_data = 0;
+    m_size = 0;
+    m_columns.clear ();
+    m_chunks.clear ();
+    m_complete = false;
+  }
+
+  const std::vector<std::string> &GetColumns (void) const
+  {
+    return m_columns;
+  }
+
+  // Index of the named column, -1 if there is none
+  int FindColumn (const std::string &name) const
+  {
+    for (uint32_t c = 0; c < m_columns.size (); c++)
+      {
+        if (m_columns[c] == name)
+          {
+            return c;
+          }
+      }
+    return -1;
+  }
+
+  uint64_t GetRows (void) const
+  {
+    uint64_t rows = 0;
+    for (uint32_t k = 0; k < m_chunks.size (); k++)
+      {
+        rows += m_chunks[k].rows;
+      }
+    return rows;
+  }
+
+  uint32_t GetChunks (void) const
+  {
+    return m_chunks.size ();
+  }
+
+  int64_t GetStart (void) const
+  {
+    int64_t start = m_chunks.empty () ? 0 : m_chunks[0].first;
+    for (uint32_t k = 1; k < m_chunks.size (); k++)
+      {
+        start = m_chunks[k].first < start ? m_chunks[k].first : start;
+      }
+    return start;
+  }
+
+  int64_t GetEnd (void) const
+  {
+    int64_t end = m_chunks.empty () ? 0 : m_chunks[0].last;
+    for (uint32_t k = 1; k < m_chunks.size (); k++)
+      {
+        end = m_chunks[k].last > end ? m_chunks[k].last : end;
+      }
+    return end;
+  }
+
+  // False when the writer did not close the file (no index)
+  bool IsComplete (void) const
+  {
+    return m_complete;
+  }
+
+  // Rows with from <= time < to, of one column
+  void Range (int64_t from, int64_t to, uint32_t column,
+              std::vector<int64_t> &times, std::vector<double> &values) const
+  {
+    times.clear ();
+    values.clear ();
+    std::vector<int64_t> t;
+    std::vector<double> v;
+    for (uint32_t k = 0; k < m_chunks.size (); k++)
+      {
+        const Chunk &chunk = m_chunks[k];
+        if (chunk.last < from || chunk.first >= to)
+          {
+            continue;
+          }
+        DecodeTimes (chunk, t);
+        DecodeColumn (chunk, column, v);
+        for (uint32_t i = 0; i < t.size (); i++)
+          {
+            if (t[i] >= from && t[i] < to)
+              {
+                times.push_back (t[i]);
+                values.push_back (v[i]);
+              }
+          }
+      }
+  }
+
+  // One column over [from, to) in equal-width buckets
+  std::vector<TimeSeriesBucket> Downsample (int64_t from, int64_t to, uint32_t column, uint32_t buckets) const
+  {
+    std::vector<TimeSeriesBucket> out;
+    if (buckets == 0 || to <= from)
+      {
+        return out;
+      }
+    int64_t width = (to - from + buckets - 1) / buckets;
+    std::vector<double> sums (buckets, 0.0);
+    out.resize (buckets);
+    for (uint32_t b = 0; b < buckets; b++)
+      {
+        out[b].start = from + b * width;
+        out[b].count = 0;
+        out[b].min = 0;
+        out[b].max = 0;
+        out[b].mean = 0;
+      }
+    std::vector<int64_t> t;
+    std::vector<double> v;
+    for (uint32_t k = 0; k < m_chunks.size (); k++)
+      {
+        const Chunk &chunk = m_chunks[k];
+        if (chunk.last < from || chunk.first >= to)
+          {
+            continue;
+          }
+        if (chunk.first >= from && chunk.last < to
+            && (chunk.first - from) / width == (chunk.last - from) / width)
+          {
+            // The whole chunk lands in one bucket: its header is enough
+            double min, max, sum;
+            ColumnStats (chunk, column, min, max, sum);
+            uint32_t b = (chunk.first - from) / width;
+            AddToBucket (out[b], sums[b], chunk.rows, min, max, sum);
+            continue;
+          }
+        DecodeTimes (chunk, t);
+        DecodeColumn (chunk, column, v);
+        for (uint32_t i = 0; i < t.size (); i++)
+          {
+            if (t[i] >= from && t[i] < to)
+              {
+                uint32_t b = (t[i] - from) / width;
+                AddToBucket (out[b], sums[b], 1, v[i], v[i], v[i]);
+              }
+          }
+      }
+    for (uint32_t b = 0; b < buckets; b++)
+      {
+        out[b].mean = out[b].count > 0 ? sums[b] / out[b].count : 0;
+      }
+    return out;
+  }
+
+private:
+  TimeSeriesReader (const TimeSeriesReader &);
+  TimeSeriesReader &operator= (const TimeSeriesReader &);
+
+  struct Chunk
+  {
+    uint64_t offset;
+    uint32_t rows;
+    int64_t first;
+    int64_t last;
+  };
+
+  static void AddToBucket (TimeSeriesBucket &bucket, double &sum, uint64_t rows, double min, double max, double add)
+  {
+    bucket.min = bucket.count == 0 || min < bucket.min ? min : bucket.min;
+    bucket.max = bucket.count == 0 || max > bucket.max ? max : bucket.max;
+    bucket.count += rows;
+    sum += add;
+  }
+
+  bool ReadHeader (void)
+  {
+    if (std::memcmp (m_data, tsc::FILE_MAGIC, 4) != 0)
+      {
+        return false;
+      }
+    uint32_t columns = tsc::Get<uint32_t> (m_data + 4);
+    m_body = 8;
+    for (uint32_t c = 0; c < columns; c++)
+      {
+        if (m_body + 2 > m_size)
+          {
+            return false;
+          }
+        uint16_t length = tsc::Get<uint16_t> (m_data + m_body);
+        if (m_body + 2 + length > m_size)
+          {
+            return false;
+          }
+        m_columns.push_back (std::string ((const char *) m_data + m_body + 2, length));
+        m_body += 2 + length;
+      }
+    return true;
+  }
+
+  // From the index, or by walking the chunks of an unfinished file
+  bool ReadChunks (void)
+  {
+    if (m_size >= m_body + tsc::TRAILER
+        && std::memcmp (m_data + m_size - 4, tsc::END_MAGIC, 4) == 0)
+      {
+        uint64_t index = tsc::Get<uint64_t> (m_data + m_size - tsc::TRAILER);
+        uint32_t chunks = tsc::Get<uint32_t> (m_data + m_size - tsc::TRAILER + 8);
+        if (index + (uint64_t) chunks * tsc::INDEX_ENTRY + tsc::TRAILER == m_size)
+          {
+            for (uint32_t k = 0; k < chunks; k++)
+              {
+                const uint8_t *p = m_data + index + k * tsc::INDEX_ENTRY;
+                Chunk chunk;
+                chunk.offset = tsc::Get<uint64_t> (p);
+                chunk.rows = tsc::Get<uint32_t> (p + 8);
+                chunk.first = tsc::Get<int64_t> (p + 12);
+                chunk.last = tsc::Get<int64_t> (p + 20);
+                if (!ValidChunk (chunk.offset, index))
+                  {
+                    return false;
+                  }
+                m_chunks.push_back (chunk);
+              }
+            m_complete = true;
+            return true;
+          }
+      }
+    uint64_t offset = m_body;
+    while (ValidChunk (offset, m_size))
+      {
+        Chunk chunk;
+        chunk.offset = offset;
+        chunk.rows = tsc::Get<uint32_t> (m_data + offset + 4);
+        chunk.first = tsc::Get<int64_t> (m_data + offset + 8);
+        chunk.last = tsc::Get<int64_t> (m_data + offset + 16);
+        m_chunks.push_back (chunk);
+        offset += tsc::CHUNK_HEADER + tsc::Get<uint32_t> (m_data + offset + 24);
+      }
+    return true;
+  }
+
+  // A whole chunk, blocks included, lies in [offset, end)
+  bool ValidChunk (uint64_t offset, uint64_t end) const
+  {
+    if (offset + tsc::CHUNK_HEADER > end || std::memcmp (m_data + offset, tsc::CHUNK_MAGIC, 4) != 0)
+      {
+        return false;
+      }
+    uint64_t chunkEnd = offset + tsc::CHUNK_HEADER + tsc::Get<uint32_t> (m_data + offset + 24);
+    uint64_t p = offset + tsc::CHUNK_HEADER + 24 * (uint64_t) m_columns.size ();
+    for (uint32_t b = 0; b <= m_columns.size (); b++)
+      {
+        if (p + 4 > chunkEnd)
+          {
+            return false;
+          }
+        p += 4 + tsc::Get<uint32_t> (m_data + p);
+      }
+    return p == chunkEnd && chunkEnd <= end;
+  }
+
+  // Start of block b of a chunk: 0 is time, 1 + c is value column c
+  const uint8_t *Block (const Chunk &chunk, uint32_t b) const
+  {
+    const uint8_t *p = m_data + chunk.offset + tsc::CHUNK_HEADER + 24 * m_columns.size ();
+    for (uint32_t i = 0; i < b; i++)
+      {
+        p += 4 + tsc::Get<uint32_t> (p);
+      }
+    return p + 4;
+  }
+
+  void ColumnStats (const Chunk &chunk, uint32_t column, double &min, double &max, double &sum) const
+  {
+    const uint8_t *p = m_data + chunk.offset + tsc::CHUNK_HEADER + 24 * column;
+    min = tsc::Get<double> (p);
+    max = tsc::Get<double> (p + 8);
+    sum = tsc::Get<double> (p + 16);
+  }
+
+  void DecodeTimes (const Chunk &chunk, std::vector<int64_t> &times) const
+  {
+    const uint8_t *p = Block (chunk, 0);
+    times.resize (chunk.rows);
+    int64_t previous = 0;
+    int64_t delta = 0;
+    for (uint32_t i = 0; i < chunk.rows; i++)
+      {
+        delta += tsc::UnZigZag (tsc::GetVarint (p));
+        previous += delta;
+        times[i] = previous;
+      }
+  }
+
+  void DecodeColumn (const Chunk &chunk, uint32_t column, std::vector<double> &values) const
+  {
+    const uint8_t *p = Block (chunk, 1 + column);
+    values.resize (chunk.rows);
+    uint64_t bits = 0;
+    for (uint32_t i = 0; i < chunk.rows; i++)
+      {
+        uint8_t control = *p++;
+        uint32_t lead = control >> 4;
+        uint32_t kept = control & 0xf;
+        uint64_t x = 0;
+        for (uint32_t b = 0; b < kept; b++)
+          {
+            x |= (uint64_t) *p++ << (56 - 8 * (lead + b));
+          }
+        bits ^= x;
+        std::memcpy (&values[i], &bits, sizeof (bits));
+      }
+  }
+
+  const uint8_t *m_data;
+  size_t m_size;
+  uint64_t m_body;   // offset of the first chunk
+  bool m_complete;
+  std::vector<std::string> m_columns;
+  std::vector<Chunk> m_chunks;
+};
+
+#endif /* TIMESERIES_H */
@@ -0,0 +1,250 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Micro-benchmarks of the wired topology setup in p1, p2 and Ip2.
+//
+// --benchTopology=<comma-separated sizes> times, at each size:
+//
+//   p2pInstall      one PointToPointHelper::Install per link, star of links
+//                   with a queue of the scenario's type (the bottleneck setup)
+//   subnetAssign    AssignLinkSubnets over the same links, stack installed
+//   dumbbellBuild   PointToPointDumbbellHelper with that many flows (p1)
+//   dumbbellStack   its InstallStack
+//   dumbbellAssign  its AssignIpv4Addresses
+//
+// perUnit is per link (per flow for the dumbbell cases). Every address plan
+// here hands out /24s from one /16, so sizes stop at 254.
+//
+
+#ifndef TOPOLOGY_BENCH_H
+#define TOPOLOGY_BENCH_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/point-to-point-dumbbell.h"
+#include "ns3/ipv4-address-generator.h"
+
+#include "micro-bench.h"
+
+// One 10.1.<i+1>.0/24 per link, in link order
+static inline std::vector<ns3::Ipv4InterfaceContainer>
+AssignLinkSubnets (const std::vector<ns3::NetDeviceContainer> &devices)
+{
+  ns3::Ipv4AddressHelper ipv4;
+  std::vector<ns3::Ipv4InterfaceContainer> interfaces (devices.size ());
+  for (uint32_t i = 0; i < devices.size (); ++i)
+    {
+      std::ostringstream subnet;
+      subnet << "10.1." << i + 1 << ".0";
+      ipv4.SetBase (subnet.str ().c_str (), "255.255.255.0");
+      interfaces[i] = ipv4.Assign (devices[i]);
+    }
+  return interfaces;
+}
+
+// Every sample starts from an empty simulation and a fresh address space
+static inline void
+ResetTopologySample (void)
+{
+  ns3::Simulator::Destroy ();
+  ns3::Ipv4AddressGenerator::Reset ();
+}
+
+class LinkBench
+{
+public:
+  enum Part { INSTALL, ADDRESSES };
+
+  LinkBench (Part part, uint32_t links, const std::string &queueType)
+    : m_part (part),
+      m_links (links)
+  {
+    m_helper.SetDeviceAttribute ("DataRate", ns3::StringValue ("10Mbps"));
+    m_helper.SetChannelAttribute ("Delay", ns3::StringValue ("10ms"));
+    m_helper.SetQueue (queueType);
+  }
+
+  void Prepare ()
+  {
+    m_nodes = ns3::NodeContainer ();
+    m_nodes.Create (m_links + 1);
+    m_devices.clear ();
+    if (m_part == ADDRESSES)
+      {
+        InstallLinks ();
+        ns3::InternetStackHelper stack;
+        stack.Install (m_nodes);
+      }
+  }
+
+  void Run ()
+  {
+    if (m_part == INSTALL)
+      {
+        InstallLinks ();
+      }
+    else
+      {
+        m_interfaces = AssignLinkSubnets (m_devices);
+      }
+  }
+
+  void Cleanup ()
+  {
+    m_interfaces.clear ();
+    m_devices.clear ();
+    m_nodes = ns3::NodeContainer ();
+    ResetTopologySample ();
+  }
+
+private:
+  // Node 0 is the hub, every other node a leaf on its own link
+  void InstallLinks ()
+  {
+    for (uint32_t i = 1; i <= m_links; i++)
+      {
+        m_devices.push_back (m_helper.Install (m_nodes.Get (0), m_nodes.Get (i)));
+      }
+  }
+
+  Part m_part;
+  uint32_t m_links;
+  ns3::PointToPointHelper m_helper;
+  ns3::NodeContainer m_nodes;
+  std::vector<ns3::NetDeviceContainer> m_devices;
+  std::vector<ns3::Ipv4InterfaceContainer> m_interfaces;
+};
+
+class DumbbellBench
+{
+public:
+  enum Part { BUILD, STACK, ADDRESSES };
+
+  DumbbellBench (Part part, uint32_t flows)
+    : m_part (part),
+      m_flows (flows),
+      m_dumbbell (0)
+  {
+    m_leaf.SetDeviceAttribute ("DataRate", ns3::StringValue ("5Mbps"));
+    m_leaf.SetChannelAttribute ("Delay", ns3::StringValue ("10ms"));
+    m_routers.SetDeviceAttribute ("DataRate", ns3::StringValue ("1Mbps"));
+    m_routers.SetChannelAttribute ("Delay", ns3::StringValue ("20ms"));
+  }
+
+  ~DumbbellBench ()
+  {
+    delete m_dumbbell;
+  }
+
+  void Prepare ()
+  {
+    if (m_part != BUILD)
+      {
+        Build ();
+      }
+    if (m_part == ADDRESSES)
+      {
+        ns3::InternetStackHelper stack;
+        m_dumbbell->InstallStack (stack);
+      }
+  }
+
+  void Run ()
+  {
+    if (m_part == BUILD)
+      {
+        Build ();
+      }
+    else if (m_part == STACK)
+      {
+        ns3::InternetStackHelper stack;
+        m_dumbbell->InstallStack (stack);
+      }
+    else
+      {
+        m_dumbbell->AssignIpv4Addresses (ns3::Ipv4AddressHelper ("10.1.1.0", "255.255.255.0"),
+                                         ns3::Ipv4AddressHelper ("10.2.1.0", "255.255.255.0"),
+                                         ns3::Ipv4AddressHelper ("10.3.1.0", "255.255.255.0"));
+      }
+  }
+
+  void Cleanup ()
+  {
+    delete m_dumbbell;
+    m_dumbbell = 0;
+    ResetTopologySample ();
+  }
+
+private:
+  // Same link parameters as p1
+  void Build ()
+  {
+    m_dumbbell = new ns3::PointToPointDumbbellHelper (m_flows, m_leaf, m_flows, m_leaf, m_routers);
+  }
+
+  Part m_part;
+  uint32_t m_flows;
+  ns3::PointToPointHelper m_leaf;
+  ns3::PointToPointHelper m_routers;
+  ns3::PointToPointDumbbellHelper *m_dumbbell;
+};
+
+// Sizes from "2,16,128"; aborts outside [1, 254]
+static inline std::vector<uint32_t>
+ParseTopologySizes (const std::string &list)
+{
+  std::vector<uint32_t> sizes;
+  std::istringstream in (list);
+  std::string item;
+  while (std::getline (in, item, ','))
+    {
+      if (item.empty ())
+        {
+          continue;
+        }
+      int size = atoi (item.c_str ());
+      NS_ABORT_MSG_IF (size < 1 || size > 254, "--benchTopology sizes must be in [1, 254]: " << item);
+      sizes.push_back (size);
+    }
+  return sizes;
+}
+
+// Link install and subnet assignment (p2, Ip2)
+static inline void
+BenchLinks (const std::string &scenario, const std::string &list, const std::string &queueType)
+{
+  MicroBench bench (scenario);
+  std::vector<uint32_t> sizes = ParseTopologySizes (list);
+  for (uint32_t i = 0; i < sizes.size (); i++)
+    {
+      LinkBench install (LinkBench::INSTALL, sizes[i], queueType);
+      bench.Measure ("p2pInstall", sizes[i], install, sizes[i]);
+      LinkBench addresses (LinkBench::ADDRESSES, sizes[i], queueType);
+      bench.Measure ("subnetAssign", sizes[i], addresses, sizes[i]);
+    }
+}
+
+// Dumbbell construction, stack and addressing (p1)
+static inline void
+BenchDumbbell (const std::string &scenario, const std::string &list)
+{
+  MicroBench bench (scenario);
+  std::vector<uint32_t> sizes = ParseTopologySizes (list);
+  const char *names[] = { "dumbbellBuild", "dumbbellStack", "dumbbellAssign" };
+  for (uint32_t i = 0; i < sizes.size (); i++)
+    {
+      for (uint32_t p = DumbbellBench::BUILD; p <= DumbbellBench::ADDRESSES; p++)
+        {
+          DumbbellBench dumbbell ((DumbbellBench::Part) p, sizes[i]);
+          bench.Measure (names[p], sizes[i], dumbbell, sizes[i]);
+        }
+    }
+}
+
+#endif /* TOPOLOGY_BENCH_H */
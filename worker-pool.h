@@ -0,0 +1,303 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+//
+// Fork-based worker pool shared by the scenario programs.
+//
+// Each job runs in a child process forked from the caller, so it starts from
+// the caller's memory image (copy-on-write) and cannot disturb the parent's
+// simulator state. The job's return value is sent back over a pipe as text.
+// With ForwardTerminationSignals, a SIGINT or SIGTERM to the caller reaches
+// the outstanding jobs before the caller dies of it.
+//
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Result of one finished job
+struct WorkerResult
+{
+  uint32_t job;
+  int status;          // as returned by waitpid ()
+  std::string output;  // whatever the job returned
+  double wallSeconds;
+};
+
+class WorkerPool
+{
+public:
+  // maxWorkers == 0 uses every online core
+  explicit WorkerPool (uint32_t maxWorkers)
+    : m_maxWorkers (maxWorkers)
+  {
+    if (m_maxWorkers == 0)
+      {
+        long cores = sysconf (_SC_NPROCESSORS_ONLN);
+        m_maxWorkers = cores > 0 ? cores : 1;
+      }
+  }
+
+  ~WorkerPool ()
+  {
+    KillAll ();
+  }
+
+  uint32_t GetMaxWorkers (void) const
+  {
+    return m_maxWorkers;
+  }
+
+  uint32_t GetRunning (void) const
+  {
+    return m_workers.size ();
+  }
+
+  bool IsFull (void) const
+  {
+    return m_workers.size () >= m_maxWorkers;
+  }
+
+  // Pass SIGINT and SIGTERM on to every running job and wait for them
+  // before dying of the signal; signals the caller was started with
+  // ignored stay ignored. One pool per process can do this.
+  void ForwardTerminationSignals (void)
+  {
+    Forwarding () = this;
+    int signals[] = { SIGINT, SIGTERM };
+    for (uint32_t i = 0; i < 2; i++)
+      {
+        struct sigaction sa;
+        sigaction (signals[i], 0, &sa);
+        if (sa.sa_handler == SIG_IGN)
+          {
+            continue;
+          }
+        memset (&sa, 0, sizeof (sa));
+        sa.sa_handler = &WorkerPool::Terminate;
+        sigemptyset (&sa.sa_mask);
+        sigaction (signals[i], &sa, 0);
+      }
+  }
+
+  // Fork a child that evaluates fn (job) and reports the returned string.
+  // Fn is any callable taking uint32_t and returning std::string.
+  template <typename Fn>
+  bool Start (uint32_t job, Fn &fn)
+  {
+    int fds[2];
+    if (pipe (fds) != 0)
+      {
+        return false;
+      }
+    std::cout.flush ();
+    std::cerr.flush ();
+    pid_t pid = fork ();
+    if (pid < 0)
+      {
+        close (fds[0]);
+        close (fds[1]);
+        return false;
+      }
+    if (pid == 0)
+      {
+        // The job handles the signals itself, if at all
+        if (Forwarding ())
+          {
+            Forwarding () = 0;
+            ResetHandler (SIGINT);
+            ResetHandler (SIGTERM);
+          }
+        close (fds[0]);
+        std::string out = fn (job);
+        WriteAll (fds[1], out);
+        close (fds[1]);
+        std::cout.flush ();
+        std::cerr.flush ();
+        _exit (0);
+      }
+    close (fds[1]);
+    Worker w;
+    w.pid = pid;
+    w.fd = fds[0];
+    w.job = job;
+    w.start = Now ();
+    SignalBlock block;
+    m_workers.push_back (w);
+    return true;
+  }
+
+  // Block until one job finishes; false when nothing is running
+  bool WaitAny (WorkerResult &result)
+  {
+    while (!m_workers.empty ())
+      {
+        std::vector<struct pollfd> fds (m_workers.size ());
+        for (uint32_t i = 0; i < m_workers.size (); i++)
+          {
+            fds[i].fd = m_workers[i].fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+          }
+        if (poll (&fds[0], fds.size (), -1) < 0)
+          {
+            if (errno == EINTR)
+              {
+                continue;
+              }
+            return false;
+          }
+        for (uint32_t i = 0; i < m_workers.size (); i++)
+          {
+            if (fds[i].revents == 0)
+              {
+                continue;
+              }
+            char buf[4096];
+            ssize_t n = read (m_workers[i].fd, buf, sizeof (buf));
+            if (n > 0)
+              {
+                m_workers[i].output.append (buf, n);
+                continue;
+              }
+            if (n < 0 && errno == EINTR)
+              {
+                continue;
+              }
+            // End of output: the child is done
+            Worker w = m_workers[i];
+            {
+              SignalBlock block;
+              m_workers.erase (m_workers.begin () + i);
+            }
+            close (w.fd);
+            int status = 0;
+            waitpid (w.pid, &status, 0);
+            result.job = w.job;
+            result.status = status;
+            result.output = w.output;
+            result.wallSeconds = Now () - w.start;
+            return true;
+          }
+      }
+    return false;
+  }
+
+  // Stop every outstanding job, e.g. once enough results are in
+  void KillAll (void)
+  {
+    SignalBlock block;
+    for (uint32_t i = 0; i < m_workers.size (); i++)
+      {
+        kill (m_workers[i].pid, SIGTERM);
+        close (m_workers[i].fd);
+        waitpid (m_workers[i].pid, 0, 0);
+      }
+    m_workers.clear ();
+  }
+
+  static double Now (void)
+  {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+private:
+  // Keeps the signal handler out while m_workers changes
+  class SignalBlock
+  {
+  public:
+    SignalBlock ()
+    {
+      sigset_t set;
+      sigemptyset (&set);
+      sigaddset (&set, SIGINT);
+      sigaddset (&set, SIGTERM);
+      sigprocmask (SIG_BLOCK, &set, &m_old);
+    }
+    ~SignalBlock ()
+    {
+      sigprocmask (SIG_SETMASK, &m_old, 0);
+    }
+
+  private:
+    sigset_t m_old;
+  };
+
+  static WorkerPool *&Forwarding (void)
+  {
+    static WorkerPool *pool = 0;
+    return pool;
+  }
+
+  static void ResetHandler (int sig)
+  {
+    struct sigaction sa;
+    sigaction (sig, 0, &sa);
+    if (sa.sa_handler == &WorkerPool::Terminate)
+      {
+        signal (sig, SIG_DFL);
+      }
+  }
+
+  static void Terminate (int sig)
+  {
+    WorkerPool *pool = Forwarding ();
+    if (pool)
+      {
+        for (uint32_t i = 0; i < pool->m_workers.size (); i++)
+          {
+            kill (pool->m_workers[i].pid, sig);
+          }
+        for (uint32_t i = 0; i < pool->m_workers.size (); i++)
+          {
+            waitpid (pool->m_workers[i].pid, 0, 0);
+          }
+      }
+    signal (sig, SIG_DFL);
+    raise (sig);
+  }
+
+  struct Worker
+  {
+    pid_t pid;
+    int fd;
+    uint32_t job;
+    double start;
+    std::string output;
+  };
+
+  static void WriteAll (int fd, const std::string &data)
+  {
+    size_t done = 0;
+    while (done < data.size ())
+      {
+        ssize_t n = write (fd, data.data () + done, data.size () - done);
+        if (n < 0 && errno == EINTR)
+          {
+            continue;
+          }
+        if (n <= 0)
+          {
+            return;
+          }
+        done += n;
+      }
+  }
+
+  uint32_t m_maxWorkers;
+  std::vector<Worker> m_workers;
+};
+
+#endif /* WORKER_POOL_H */